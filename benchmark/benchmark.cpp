@@ -0,0 +1,97 @@
+#include "precomp.h" // include (only) this in every .cpp file
+
+// -----------------------------------------------------------
+// Headless benchmark
+// Runs Game::init/update (and optionally Game::draw into an offscreen surface)
+// for a fixed number of frames without opening a window, and prints the time per phase
+// followed by the per-zone profile summary.
+//
+// Usage: benchmark [frames] [blue tanks] [red tanks] [--draw]
+// Run it from the project root so the assets folder can be found.
+// -----------------------------------------------------------
+
+constexpr auto default_frames = 2000;
+constexpr auto default_tanks_per_team = 2048;
+
+static void print_phase(const char* name, float total_ms, int frames)
+{
+    printf("%-8s %12.1f ms %10.3f ms/frame\n", name, total_ms, total_ms / frames);
+}
+
+int main(int argc, char** argv)
+{
+    int frames = default_frames;
+    int num_blue = default_tanks_per_team;
+    int num_red = default_tanks_per_team;
+    bool draw = false;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--draw") == 0)
+        {
+            draw = true;
+            continue;
+        }
+
+        const int value = atoi(argv[i]);
+        switch (positional++)
+        {
+        case 0: frames = value; break;
+        case 1: num_blue = value; break;
+        case 2: num_red = value; break;
+        default: break;
+        }
+    }
+
+    if (frames < 1 || num_blue < 1 || num_red < 1 || positional > 3)
+    {
+        printf("Usage: %s [frames] [blue tanks] [red tanks] [--draw]\n", argv[0]);
+        return 1;
+    }
+
+    printf("Frames: %i, tanks: %i blue / %i red, draw: %s\n", frames, num_blue, num_red, draw ? "on" : "off");
+
+    //Offscreen framebuffer with the same size as the window
+    Surface* screen = new Surface(SCRWIDTH, SCRHEIGHT);
+    screen->clear(0);
+
+    Game* game = new Game();
+    game->set_target(screen);
+
+    timer phase_timer;
+    game->init(num_blue, num_red);
+    const float init_ms = phase_timer.elapsed();
+
+    float update_ms = 0.f;
+    float draw_ms = 0.f;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        phase_timer.reset();
+        game->update(0.f);
+        update_ms += phase_timer.elapsed();
+
+        if (draw)
+        {
+            phase_timer.reset();
+            game->draw();
+            draw_ms += phase_timer.elapsed();
+        }
+
+        frame_profiler.end_frame();
+    }
+
+    printf("init     %12.1f ms\n", init_ms);
+    print_phase("update", update_ms, frames);
+    if (draw) print_phase("draw", draw_ms, frames);
+    print_phase("total", update_ms + draw_ms, frames);
+    printf("\n");
+    frame_profiler.print_summary();
+    printf("\nRoute cache: %zu hits, %zu misses\n", game->get_terrain().get_route_cache_hits(), game->get_terrain().get_route_cache_misses());
+
+    game->shutdown();
+    delete game;
+    delete screen;
+
+    return 0;
+}
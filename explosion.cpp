@@ -11,8 +11,7 @@ void Tmpl8::Explosion::tick()
     if (current_frame < 18) current_frame++;
 }
 
-void Tmpl8::Explosion::draw(Surface* screen)
+void Tmpl8::Explosion::draw(RenderQueue& render_queue)
 {
-    explosion_sprite->set_frame(current_frame / 2);
-    explosion_sprite->draw(screen, (int)position.x + HEALTHBAR_OFFSET, (int)position.y);
+    render_queue.add(explosion_sprite, current_frame / 2, (int)position.x + HEALTHBAR_OFFSET, (int)position.y);
 }
@@ -10,7 +10,7 @@ class Explosion
 
     bool done() const;
     void tick();
-    void draw(Surface* screen);
+    void draw(RenderQueue& render_queue);
 
     vec2 position;
 
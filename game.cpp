@@ -41,16 +41,42 @@ const static vec2 rocket_size(6, 6);
 const static float tank_radius = 3.f;
 const static float rocket_radius = 5.f;
 
+const static float target_grid_cell_size = 32.f;
+
+//Smallest amount of work worth handing to another thread
+constexpr size_t min_tanks_per_task = 256;
+constexpr size_t min_rockets_per_task = 64;
+
 // -----------------------------------------------------------
 // Initialize the simulation state
 // This function does not count for the performance multiplier
 // (Feel free to optimize anyway though ;) )
 // -----------------------------------------------------------
 void Game::init()
+{
+    init(num_tanks_blue, num_tanks_red);
+}
+
+// -----------------------------------------------------------
+// Initialize the simulation state with a custom number of tanks per team (used by the benchmark)
+// -----------------------------------------------------------
+void Game::init(int num_blue, int num_red)
 {
     frame_count_font = new Font("assets/digital_small.png", "ABCDEFGHIJKLMNOPQRSTUVWXYZ:?!=-0123456789.");
 
-    tanks.reserve(num_tanks_blue + num_tanks_red);
+    tank_count_blue = num_blue;
+    tank_count_red = num_red;
+
+    tanks.reserve(tank_count_blue + tank_count_red);
+
+    //Cells as large as the collision distance, so colliding tanks are always in neighbouring cells
+    tank_grid = SpatialGrid(tank_radius * 2, SCRWIDTH - (HEALTHBAR_OFFSET * 2), SCRHEIGHT);
+
+    //Enemies are usually far away, so use coarse cells to keep the ring search short
+    for (SpatialGrid& grid : team_grids)
+    {
+        grid = SpatialGrid(target_grid_cell_size, SCRWIDTH - (HEALTHBAR_OFFSET * 2), SCRHEIGHT);
+    }
 
     uint max_rows = 24;
 
@@ -63,16 +89,16 @@ void Game::init()
     float spacing = 7.5f;
 
     //Spawn blue tanks
-    for (int i = 0; i < num_tanks_blue; i++)
+    for (int i = 0; i < tank_count_blue; i++)
     {
         vec2 position{ start_blue_x + ((i % max_rows) * spacing), start_blue_y + ((i / max_rows) * spacing) };
-        tanks.push_back(Tank(position.x, position.y, BLUE, &tank_blue, &smoke, 1100.f, position.y + 16, tank_radius, tank_max_health, tank_max_speed));
+        tanks.add(position.x, position.y, BLUE, &tank_blue, &smoke, 1100.f, position.y + 16, tank_radius, tank_max_health, tank_max_speed);
     }
     //Spawn red tanks
-    for (int i = 0; i < num_tanks_red; i++)
+    for (int i = 0; i < tank_count_red; i++)
     {
         vec2 position{ start_red_x + ((i % max_rows) * spacing), start_red_y + ((i / max_rows) * spacing) };
-        tanks.push_back(Tank(position.x, position.y, RED, &tank_red, &smoke, 100.f, position.y + 16, tank_radius, tank_max_health, tank_max_speed));
+        tanks.add(position.x, position.y, RED, &tank_red, &smoke, 100.f, position.y + 16, tank_radius, tank_max_health, tank_max_speed);
     }
 
     particle_beams.push_back(Particle_beam(vec2(590, 327), vec2(100, 50), &particle_beam_sprite, particle_beam_hit_value));
@@ -88,33 +114,39 @@ void Game::shutdown()
 }
 
 // -----------------------------------------------------------
-// Iterates through all tanks and returns the closest enemy tank for the given tank
+// Returns the closest active enemy tank for the given tank using the enemy team grid
+// (team_grids has to be built this frame, see Game::update)
+// -----------------------------------------------------------
+Tank Game::find_closest_enemy(const Tank& current_tank)
+{
+    const SpatialGrid& enemies = team_grids[(current_tank.get_allignment() == RED) ? BLUE : RED];
+    const int closest_index = enemies.find_nearest(current_tank.get_position());
+
+    //No active enemies left, fall back to the first tank like the original linear scan
+    return tanks[(closest_index >= 0) ? closest_index : 0];
+}
+
+// -----------------------------------------------------------
+// Returns the lowest index active enemy tank the rocket collides with, or -1
+// targets is scratch space for the grid query, so parallel callers can each pass their own
 // -----------------------------------------------------------
-Tank& Game::find_closest_enemy(Tank& current_tank)
+int Game::find_rocket_hit(const Rocket& rocket, vector<int>& targets) const
 {
-    float closest_distance = numeric_limits<float>::infinity();
-    int closest_index = 0;
+    //Only enemy tanks in the grid cells around the rocket can be hit (tanks haven't moved since the grids were built)
+    targets.clear();
+    team_grids[(rocket.allignment == RED) ? BLUE : RED].query(rocket.position, rocket.collision_radius + tank_radius, targets);
 
-    for (int i = 0; i < tanks.size(); i++)
+    //The lowest index wins, the same tank a scan over all tanks would hit first
+    int hit_index = -1;
+    for (int i : targets)
     {
-        if (tanks.at(i).allignment != current_tank.allignment && tanks.at(i).active)
+        if ((hit_index < 0 || i < hit_index) && tanks.actives[i] && rocket.intersects(tanks.positions[i], tanks.collision_radii[i]))
         {
-            float sqr_dist = fabsf((tanks.at(i).get_position() - current_tank.get_position()).sqr_length());
-            if (sqr_dist < closest_distance)
-            {
-                closest_distance = sqr_dist;
-                closest_index = i;
-            }
+            hit_index = i;
         }
     }
 
-    return tanks.at(closest_index);
-}
-
-//Checks if a point lies on the left of an arbitrary angled line
-bool Tmpl8::Game::left_of_line(vec2 line_start, vec2 line_end, vec2 point)
-{
-    return ((line_end.x - line_start.x) * (point.y - line_start.y) - (line_end.y - line_start.y) * (point.x - line_start.x)) < 0;
+    return hit_index;
 }
 
 // -----------------------------------------------------------
@@ -126,315 +158,414 @@ bool Tmpl8::Game::left_of_line(vec2 line_start, vec2 line_end, vec2 point)
 // -----------------------------------------------------------
 void Game::update(float deltaTime)
 {
+    PROFILE_SCOPE("update");
+
     //Calculate the route to the destination for each tank using BFS
     //Initializing routes here so it gets counted for performance..
-    if (frame_count == 0)
+    if (!routes_initialized)
     {
-        for (Tank& t : tanks)
+        PROFILE_SCOPE("update/routes");
+        routes_initialized = true;
+
+        for (size_t i = 0; i < tanks.size(); i++)
         {
-            t.set_route(background_terrain.get_route(t, t.target));
+            Tank t = tanks[i];
+            t.set_route(background_terrain.get_route(t, t.get_target()));
         }
     }
 
-    //Check tank collision and nudge tanks away from each other
-    for (Tank& tank : tanks)
     {
-        if (tank.active)
+        PROFILE_SCOPE("update/collision");
+
+        //Bucket active tanks in the grid so collision checks only visit nearby tanks
+        tank_grid.clear();
+        for (int i = 0; i < (int)tanks.size(); i++)
         {
-            for (Tank& other_tank : tanks)
+            if (tanks.actives[i])
             {
-                if (&tank == &other_tank || !other_tank.active) continue;
+                tank_grid.add(i, tanks.positions[i]);
+            }
+        }
+        tank_grid.build();
+
+        //Check tank collision and nudge tanks away from each other
+        //Every tank only pushes itself, so chunks of tanks can be handled in parallel
+        thread_pool.parallel_for(tanks.size(), min_tanks_per_task, [this](size_t begin, size_t end) {
+            vector<int> neighbours;
+            for (int i = (int)begin; i < (int)end; i++)
+            {
+                if (tanks.actives[i])
+                {
+                    const vec2 position = tanks.positions[i];
+                    const float collision_radius = tanks.collision_radii[i];
+
+                    //All tanks share tank_radius, so anything that can touch this tank lies within the query range
+                    neighbours.clear();
+                    tank_grid.query(position, collision_radius + tank_radius, neighbours);
+
+                    //Sort so nudges are accumulated in the same order as a full scan over all tanks
+                    std::sort(neighbours.begin(), neighbours.end());
+
+                    for (int j : neighbours)
+                    {
+                        if (j == i) continue;
 
-                vec2 dir = tank.get_position() - other_tank.get_position();
-                float dir_squared_len = dir.sqr_length();
+                        vec2 dir = position - tanks.positions[j];
+                        float dir_squared_len = dir.sqr_length();
 
-                float col_squared_len = (tank.get_collision_radius() + other_tank.get_collision_radius());
-                col_squared_len *= col_squared_len;
+                        float col_squared_len = (collision_radius + tanks.collision_radii[j]);
+                        col_squared_len *= col_squared_len;
 
-                if (dir_squared_len < col_squared_len)
+                        if (dir_squared_len < col_squared_len)
+                        {
+                            tanks[i].push(dir.normalized(), 1.f);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    {
+        PROFILE_SCOPE("update/tanks");
+
+        //Update tanks
+        thread_pool.parallel_for(tanks.size(), min_tanks_per_task, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                if (tanks.actives[i])
                 {
-                    tank.push(dir.normalized(), 1.f);
+                    //Move tanks according to speed and nudges (see above) also reload
+                    tanks[i].tick(background_terrain);
                 }
             }
-        }
+        });
     }
 
-    //Update tanks
-    for (Tank& tank : tanks)
     {
-        if (tank.active)
+        PROFILE_SCOPE("update/targeting");
+
+        //Index the moved tanks per team so closest enemy lookups don't scan every tank
+        for (SpatialGrid& grid : team_grids)
+        {
+            grid.clear();
+        }
+        for (int i = 0; i < (int)tanks.size(); i++)
+        {
+            if (tanks.actives[i])
+            {
+                team_grids[tanks.teams[i]].add(i, tanks.positions[i]);
+            }
+        }
+        for (SpatialGrid& grid : team_grids)
         {
-            //Move tanks according to speed and nudges (see above) also reload
-            tank.tick(background_terrain);
+            grid.build();
+        }
 
-            //Shoot at closest target if reloaded
-            if (tank.rocket_reloaded())
+        //Find the closest target of every reloaded tank in parallel, -1 means the tank doesn't shoot
+        shot_targets.resize(tanks.size());
+        thread_pool.parallel_for(tanks.size(), min_tanks_per_task, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                Tank tank = tanks[i];
+                shot_targets[i] = (tank.is_active() && tank.rocket_reloaded()) ? find_closest_enemy(tank).get_index() : -1;
+            }
+        });
+
+        //Shoot at closest target if reloaded, in tank order so rockets are spawned in the same order every run
+        for (size_t i = 0; i < tanks.size(); i++)
+        {
+            if (shot_targets[i] >= 0)
             {
-                Tank& target = find_closest_enemy(tank);
+                Tank tank = tanks[i];
+                Tank target = tanks[shot_targets[i]];
 
-                rockets.push_back(Rocket(tank.position, (target.get_position() - tank.position).normalized() * 3, rocket_radius, tank.allignment, ((tank.allignment == RED) ? &rocket_red : &rocket_blue)));
+                rockets.push_back(Rocket(tank.get_position(), (target.get_position() - tank.get_position()).normalized() * 3, rocket_radius, tank.get_allignment(), ((tank.get_allignment() == RED) ? &rocket_red : &rocket_blue)));
 
                 tank.reload_rocket();
             }
         }
     }
 
-    //Update smoke plumes
-    for (Smoke& smoke : smokes)
     {
-        smoke.tick();
-    }
-
-    //Calculate "forcefield" around active tanks
-    forcefield_hull.clear();
+        PROFILE_SCOPE("update/smoke");
 
-    //Find first active tank (this loop is a bit disgusting, fix?)
-    int first_active = 0;
-    for (Tank& tank : tanks)
-    {
-        if (tank.active)
+        //Update smoke plumes
+        for (Smoke& smoke : smokes)
         {
-            break;
+            smoke.tick();
         }
-        first_active++;
     }
-    vec2 point_on_hull = tanks.at(first_active).position;
-    //Find left most tank position
-    for (Tank& tank : tanks)
+
     {
-        if (tank.active)
+        PROFILE_SCOPE("update/hull");
+
+        //Calculate convex hull around active tanks for the 'rocket barrier' forcefield
+        active_positions.clear();
+        for (size_t i = 0; i < tanks.size(); i++)
         {
-            if (tank.position.x <= point_on_hull.x)
+            if (tanks.actives[i])
             {
-                point_on_hull = tank.position;
+                active_positions.push_back(tanks.positions[i]);
             }
         }
+        convex_hull(active_positions, forcefield_hull);
     }
 
-    //Calculate convex hull for 'rocket barrier'
-    for (Tank& tank : tanks)
     {
-        if (tank.active)
-        {
-            forcefield_hull.push_back(point_on_hull);
-            vec2 endpoint = tanks.at(first_active).position;
+        PROFILE_SCOPE("update/rockets");
 
-            for (Tank& tank : tanks)
+        //Move rockets and find the tank each one hits in parallel, using the tanks that are active before any rocket hits
+        rocket_hits.resize(rockets.size());
+        thread_pool.parallel_for(rockets.size(), min_rockets_per_task, [this](size_t begin, size_t end) {
+            vector<int> targets;
+            for (size_t r = begin; r < end; r++)
             {
-                if (tank.active)
-                {
-                    if ((endpoint == point_on_hull) || left_of_line(point_on_hull, endpoint, tank.position))
-                    {
-                        endpoint = tank.position;
-                    }
-                }
+                rockets[r].tick();
+                rocket_hits[r] = find_rocket_hit(rockets[r], targets);
             }
-            point_on_hull = endpoint;
+        });
+
+        //Apply the hits in rocket order
+        for (size_t r = 0; r < rockets.size(); r++)
+        {
+            Rocket& rocket = rockets[r];
+            int hit_index = rocket_hits[r];
 
-            if (endpoint == forcefield_hull.at(0))
+            //An earlier rocket destroyed the tank this one would hit, so look again among the tanks that are left
+            if (hit_index >= 0 && !tanks.actives[hit_index])
             {
-                break;
+                hit_index = find_rocket_hit(rocket, rocket_targets);
             }
-        }
-    }
 
-    //Update rockets
-    for (Rocket& rocket : rockets)
-    {
-        rocket.tick();
-
-        //Check if rocket collides with enemy tank, spawn explosion, and if tank is destroyed spawn a smoke plume
-        for (Tank& tank : tanks)
-        {
-            if (tank.active && (tank.allignment != rocket.allignment) && rocket.intersects(tank.position, tank.collision_radius))
+            //Check if rocket collides with enemy tank, spawn explosion, and if tank is destroyed spawn a smoke plume
+            if (hit_index >= 0)
             {
-                explosions.push_back(Explosion(&explosion, tank.position));
+                Tank tank = tanks[hit_index];
+                explosions.push_back(Explosion(&explosion, tank.get_position()));
 
                 if (tank.hit(rocket_hit_value))
                 {
-                    smokes.push_back(Smoke(smoke, tank.position - vec2(7, 24)));
+                    smokes.push_back(Smoke(smoke, tank.get_position() - vec2(7, 24)));
                 }
 
                 rocket.active = false;
-                break;
             }
         }
     }
 
-    //Disable rockets if they collide with the "forcefield"
-    //Hint: A point to convex hull intersection test might be better here? :) (Disable if outside)
-    for (Rocket& rocket : rockets)
     {
-        if (rocket.active)
+        PROFILE_SCOPE("update/forcefield");
+
+        //Shrink the forcefield by the rocket radius, so a rocket whose collision circle touches the hull ends up outside of it
+        inset_convex_polygon(forcefield_hull, rocket_radius, forcefield_inner_hull);
+
+        //Disable rockets if they collide with the "forcefield" or are outside of it
+        for (Rocket& rocket : rockets)
         {
-            for (size_t i = 0; i < forcefield_hull.size(); i++)
+            if (rocket.active && !point_in_convex_polygon(forcefield_inner_hull, rocket.position))
             {
-                if (circle_segment_intersect(forcefield_hull.at(i), forcefield_hull.at((i + 1) % forcefield_hull.size()), rocket.position, rocket.collision_radius))
-                {
-                    explosions.push_back(Explosion(&explosion, rocket.position));
-                    rocket.active = false;
-                }
+                explosions.push_back(Explosion(&explosion, rocket.position));
+                rocket.active = false;
             }
         }
-    }
-
-
 
-    //Remove exploded rockets with remove erase idiom
-    rockets.erase(std::remove_if(rockets.begin(), rockets.end(), [](const Rocket& rocket) { return !rocket.active; }), rockets.end());
+        //Remove exploded rockets with remove erase idiom
+        rockets.erase(std::remove_if(rockets.begin(), rockets.end(), [](const Rocket& rocket) { return !rocket.active; }), rockets.end());
+    }
 
-    //Update particle beams
-    for (Particle_beam& particle_beam : particle_beams)
     {
-        particle_beam.tick(tanks);
+        PROFILE_SCOPE("update/particle beams");
 
-        //Damage all tanks within the damage window of the beam (the window is an axis-aligned bounding box)
-        for (Tank& tank : tanks)
+        //Update particle beams
+        beam_kills.resize(tanks.size());
+        for (Particle_beam& particle_beam : particle_beams)
         {
-            if (tank.active && particle_beam.rectangle.intersects_circle(tank.get_position(), tank.get_collision_radius()))
+            particle_beam.tick(tanks);
+
+            //Damage all tanks within the damage window of the beam (the window is an axis-aligned bounding box)
+            thread_pool.parallel_for(tanks.size(), min_tanks_per_task, [this, &particle_beam](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    beam_kills[i] = (tanks.actives[i] && particle_beam.rectangle.intersects_circle(tanks.positions[i], tanks.collision_radii[i]) && tanks[i].hit(particle_beam.damage));
+                }
+            });
+
+            //Spawn smoke plumes for destroyed tanks in tank order
+            for (size_t i = 0; i < tanks.size(); i++)
             {
-                if (tank.hit(particle_beam.damage))
+                if (beam_kills[i])
                 {
-                    smokes.push_back(Smoke(smoke, tank.position - vec2(0, 48)));
+                    smokes.push_back(Smoke(smoke, tanks.positions[i] - vec2(0, 48)));
                 }
             }
         }
     }
 
-    //Update explosion sprites and remove when done with remove erase idiom
-    for (Explosion& explosion : explosions)
     {
-        explosion.tick();
-    }
+        PROFILE_SCOPE("update/explosions");
+
+        //Update explosion sprites and remove when done with remove erase idiom
+        for (Explosion& explosion : explosions)
+        {
+            explosion.tick();
+        }
 
-    explosions.erase(std::remove_if(explosions.begin(), explosions.end(), [](const Explosion& explosion) { return explosion.done(); }), explosions.end());
+        explosions.erase(std::remove_if(explosions.begin(), explosions.end(), [](const Explosion& explosion) { return explosion.done(); }), explosions.end());
+    }
 }
 
 // -----------------------------------------------------------
 // Draw all sprites to the screen
-// (It is not recommended to multi-thread this function)
+// (Sprites are drawn in parallel per screen tile by the render queue)
 // -----------------------------------------------------------
 void Game::draw()
 {
-    // clear the graphics window
-    screen->clear(0);
-
-    //Draw background
-    background_terrain.draw(screen);
+    PROFILE_SCOPE("draw");
 
-    //Draw sprites
-    for (int i = 0; i < num_tanks_blue + num_tanks_red; i++)
     {
-        tanks.at(i).draw(screen);
+        PROFILE_SCOPE("draw/background");
 
-        vec2 tank_pos = tanks.at(i).get_position();
+        //Draw background, this covers the whole screen so it doesn't need to be cleared first
+        background_terrain.draw(screen);
     }
 
-    for (Rocket& rocket : rockets)
     {
-        rocket.draw(screen);
-    }
+        PROFILE_SCOPE("draw/sprites");
 
-    for (Smoke& smoke : smokes)
-    {
-        smoke.draw(screen);
-    }
+        //Queue the sprites a layer per kind, so draws of the same sprite and frame end up next to each other
+        render_queue.begin_layer();
+        for (size_t i = 0; i < tanks.size(); i++)
+        {
+            tanks[i].draw(render_queue);
+        }
 
-    for (Particle_beam& particle_beam : particle_beams)
-    {
-        particle_beam.draw(screen);
-    }
+        render_queue.begin_layer();
+        for (Rocket& rocket : rockets)
+        {
+            rocket.draw(render_queue);
+        }
 
-    for (Explosion& explosion : explosions)
-    {
-        explosion.draw(screen);
+        render_queue.begin_layer();
+        for (Smoke& smoke : smokes)
+        {
+            smoke.draw(render_queue);
+        }
+
+        render_queue.begin_layer();
+        for (Particle_beam& particle_beam : particle_beams)
+        {
+            particle_beam.draw(render_queue);
+        }
+
+        render_queue.begin_layer();
+        for (Explosion& explosion : explosions)
+        {
+            explosion.draw(render_queue);
+        }
+
+        render_queue.submit(screen, thread_pool);
     }
 
-    //Draw forcefield (mostly for debugging, its kinda ugly..)
-    for (size_t i = 0; i < forcefield_hull.size(); i++)
     {
-        vec2 line_start = forcefield_hull.at(i);
-        vec2 line_end = forcefield_hull.at((i + 1) % forcefield_hull.size());
-        line_start.x += HEALTHBAR_OFFSET;
-        line_end.x += HEALTHBAR_OFFSET;
-        screen->line(line_start, line_end, 0x0000ff);
+        PROFILE_SCOPE("draw/forcefield");
+
+        //Draw forcefield (mostly for debugging, its kinda ugly..)
+        for (size_t i = 0; i < forcefield_hull.size(); i++)
+        {
+            vec2 line_start = forcefield_hull.at(i);
+            vec2 line_end = forcefield_hull.at((i + 1) % forcefield_hull.size());
+            line_start.x += HEALTHBAR_OFFSET;
+            line_end.x += HEALTHBAR_OFFSET;
+            screen->line(line_start, line_end, 0x0000ff);
+        }
     }
 
     //Draw sorted health bars
     for (int t = 0; t < 2; t++)
     {
-        const int NUM_TANKS = ((t < 1) ? num_tanks_blue : num_tanks_red);
+        const int NUM_TANKS = ((t < 1) ? tank_count_blue : tank_count_red);
 
-        const int begin = ((t < 1) ? 0 : num_tanks_blue);
-        std::vector<const Tank*> sorted_tanks;
-        insertion_sort_tanks_health(tanks, sorted_tanks, begin, begin + NUM_TANKS);
-        sorted_tanks.erase(std::remove_if(sorted_tanks.begin(), sorted_tanks.end(), [](const Tank* tank) { return !tank->active; }), sorted_tanks.end());
+        const int begin = ((t < 1) ? 0 : tank_count_blue);
+        //Only the <SCRHEIGHT> least healthy tanks get a health bar
+        std::vector<Tank>& sorted_tanks = health_sorted_tanks[t];
+        {
+            PROFILE_SCOPE("draw/health sort");
+            select_least_healthy_tanks(tanks, sorted_tanks, begin, begin + NUM_TANKS, SCRHEIGHT);
+        }
 
+        PROFILE_SCOPE("draw/health bars");
         draw_health_bars(sorted_tanks, t);
     }
 }
 
 // -----------------------------------------------------------
-// Sort tanks by health value using insertion sort
+// Select the max_count least healthy active tanks, ordered by health value, using a counting sort
+// Active tanks always have 1 up to tank_max_health health, so every value gets a bucket
+// Tanks with the same health stay in index order, like they did with the insertion sort this replaced
+// Only the selected tanks are written, so asking for a handful of the worst units costs a counting pass
 // -----------------------------------------------------------
-void Tmpl8::Game::insertion_sort_tanks_health(const std::vector<Tank>& original, std::vector<const Tank*>& sorted_tanks, int begin, int end)
+void Tmpl8::Game::select_least_healthy_tanks(TankPool& original, std::vector<Tank>& selected_tanks, int begin, int end, size_t max_count)
 {
-    const int NUM_TANKS = end - begin;
-    sorted_tanks.reserve(NUM_TANKS);
-    sorted_tanks.emplace_back(&original.at(begin));
+    health_counts.assign(tank_max_health + 1, 0);
 
-    for (int i = begin + 1; i < (begin + NUM_TANKS); i++)
+    uint32_t active_count = 0;
+    for (int i = begin; i < end; i++)
     {
-        const Tank& current_tank = original.at(i);
+        if (!original.actives[i]) continue;
 
-        for (int s = (int)sorted_tanks.size() - 1; s >= 0; s--)
-        {
-            const Tank* current_checking_tank = sorted_tanks.at(s);
+        assert(original.healths[i] > 0 && original.healths[i] <= tank_max_health);
+        health_counts[original.healths[i]]++;
+        active_count++;
+    }
 
-            if ((current_checking_tank->compare_health(current_tank) <= 0))
-            {
-                sorted_tanks.insert(1 + sorted_tanks.begin() + s, &current_tank);
-                break;
-            }
+    //Turn the counts into the first slot of every health value
+    uint32_t first = 0;
+    for (uint32_t& count : health_counts)
+    {
+        const uint32_t bucket_size = count;
+        count = first;
+        first += bucket_size;
+    }
 
-            if (s == 0)
-            {
-                sorted_tanks.insert(sorted_tanks.begin(), &current_tank);
-                break;
-            }
-        }
+    //Tanks whose slot lands past max_count are healthier than every selected one
+    selected_tanks.resize(std::min((size_t)active_count, max_count));
+    for (int i = begin; i < end; i++)
+    {
+        if (!original.actives[i]) continue;
+
+        const uint32_t slot = health_counts[original.healths[i]]++;
+        if (slot < selected_tanks.size()) selected_tanks[slot] = original[i];
     }
 }
 
 // -----------------------------------------------------------
 // Draw the health bars based on the given tanks health values
+// Every row is written once, the red and green parts of a bar are filled together
 // -----------------------------------------------------------
-void Tmpl8::Game::draw_health_bars(const std::vector<const Tank*>& sorted_tanks, const int team)
+void Tmpl8::Game::draw_health_bars(const std::vector<Tank>& sorted_tanks, const int team)
 {
-    int health_bar_start_x = (team < 1) ? 0 : (SCRWIDTH - HEALTHBAR_OFFSET) - 1;
-    int health_bar_end_x = (team < 1) ? health_bar_width : health_bar_start_x + health_bar_width - 1;
-
-    for (int i = 0; i < SCRHEIGHT - 1; i++)
-    {
-        //Health bars are 1 pixel each
-        int health_bar_start_y = i * 1;
-        int health_bar_end_y = health_bar_start_y + 1;
-
-        screen->bar(health_bar_start_x, health_bar_start_y, health_bar_end_x, health_bar_end_y, REDMASK);
-    }
-
-    //Draw the <SCRHEIGHT> least healthy tank health bars
-    int draw_count = std::min(SCRHEIGHT, (int)sorted_tanks.size());
-    for (int i = 0; i < draw_count - 1; i++)
+    //Blue bars grow green from the right, red bars from the left, the end is exclusive
+    const int health_bar_start_x = (team < 1) ? 0 : (SCRWIDTH - HEALTHBAR_OFFSET) - 1;
+    const int health_bar_end_x = (team < 1) ? health_bar_width + 1 : health_bar_start_x + health_bar_width;
+
+    //Draw the <SCRHEIGHT> least healthy tank health bars, rows without a tank stay red
+    //Bars used to be 2 rows tall with the next one drawn on top, so the last one also covers the row below it
+    const int draw_count = std::min(SCRHEIGHT, (int)sorted_tanks.size());
+    for (int y = 0; y < SCRHEIGHT; y++)
     {
-        //Health bars are 1 pixel each
-        int health_bar_start_y = i * 1;
-        int health_bar_end_y = health_bar_start_y + 1;
+        const int i = (y < draw_count - 1) ? y : y - 1;
+        if ((i < 0) || (i >= draw_count - 1))
+        {
+            screen->fill_row(y, health_bar_start_x, health_bar_end_x, health_bar_end_x, REDMASK, REDMASK);
+            continue;
+        }
 
-        float health_fraction = (1 - ((double)sorted_tanks.at(i)->health / (double)tank_max_health));
+        float health_fraction = (1 - ((double)sorted_tanks[i].get_health() / (double)tank_max_health));
+        const int red_width = (int)((double)health_bar_width * health_fraction);
 
-        if (team == 0) { screen->bar(health_bar_start_x + (int)((double)health_bar_width * health_fraction), health_bar_start_y, health_bar_end_x, health_bar_end_y, GREENMASK); }
-        else { screen->bar(health_bar_start_x, health_bar_start_y, health_bar_end_x - (int)((double)health_bar_width * health_fraction), health_bar_end_y, GREENMASK); }
+        if (team == 0) { screen->fill_row(y, health_bar_start_x, health_bar_start_x + red_width, health_bar_end_x, REDMASK, GREENMASK); }
+        else { screen->fill_row(y, health_bar_start_x, health_bar_end_x - red_width, health_bar_end_x, GREENMASK, REDMASK); }
     }
 }
 
@@ -452,6 +583,8 @@ void Tmpl8::Game::measure_performance()
         {
             duration = perf_timer.elapsed();
             cout << "Duration was: " << duration << " (Replace REF_PERFORMANCE with this value)" << endl;
+            frame_profiler.print_summary();
+            cout << "Route cache: " << background_terrain.get_route_cache_hits() << " hits, " << background_terrain.get_route_cache_misses() << " misses" << endl;
             lock_update = true;
         }
 
@@ -480,6 +613,9 @@ void Game::tick(float deltaTime)
     }
     draw();
 
+    //Store this frame's zone times before measure_performance prints the summary on the last frame
+    frame_profiler.end_frame();
+
     measure_performance();
 
     // print something in the graphics window
@@ -4,6 +4,7 @@ namespace Tmpl8
 {
 //forward declarations
 class Tank;
+class TankPool;
 class Rocket;
 class Smoke;
 class Particle_beam;
@@ -13,15 +14,19 @@ class Game
   public:
     void set_target(Surface* surface) { screen = surface; }
     void init();
+    void init(int num_blue, int num_red);
     void shutdown();
     void update(float deltaTime);
     void draw();
     void tick(float deltaTime);
-    void insertion_sort_tanks_health(const std::vector<Tank>& original, std::vector<const Tank*>& sorted_tanks, int begin, int end);
-    void draw_health_bars(const std::vector<const Tank*>& sorted_tanks, const int team);
+    void select_least_healthy_tanks(TankPool& original, std::vector<Tank>& selected_tanks, int begin, int end, size_t max_count);
+    void draw_health_bars(const std::vector<Tank>& sorted_tanks, const int team);
     void measure_performance();
 
-    Tank& find_closest_enemy(Tank& current_tank);
+    const Terrain& get_terrain() const { return background_terrain; }
+
+    Tank find_closest_enemy(const Tank& current_tank);
+    int find_rocket_hit(const Rocket& rocket, vector<int>& targets) const;
 
     void mouse_up(int button)
     { /* implement if you want to detect mouse button presses */
@@ -46,22 +51,43 @@ class Game
   private:
     Surface* screen;
 
-    vector<Tank> tanks;
+    TankPool tanks;
+    int tank_count_blue = 0;
+    int tank_count_red = 0;
     vector<Rocket> rockets;
     vector<Smoke> smokes;
     vector<Explosion> explosions;
     vector<Particle_beam> particle_beams;
 
+    //The calling thread also runs a chunk of every parallel_for, so use one worker less than there are hardware threads
+    ThreadPool thread_pool{ std::max(std::thread::hardware_concurrency(), 2u) - 1 };
+
+    SpatialGrid tank_grid;
+
+    //Active tanks per allignment, used to find the closest enemy
+    std::array<SpatialGrid, 2> team_grids;
+    vector<int> rocket_targets;
+
+    //Results of the parallel passes, merged in index order on the main thread so the outcome matches a serial update
+    vector<int> shot_targets;
+    vector<int> rocket_hits;
+    vector<char> beam_kills;
+
     Terrain background_terrain;
+    RenderQueue render_queue;
+    std::vector<vec2> active_positions;
     std::vector<vec2> forcefield_hull;
+    std::vector<vec2> forcefield_inner_hull;
+
+    //Least healthy active tanks per team ordered by health and the buckets used to select them, kept between frames so drawing doesn't allocate
+    std::array<vector<Tank>, 2> health_sorted_tanks;
+    vector<uint32_t> health_counts;
 
     Font* frame_count_font;
     long long frame_count = 0;
 
     bool lock_update = false;
-
-    //Checks if a point lies on the left of an arbitrary angled line
-    bool left_of_line(vec2 line_start, vec2 line_end, vec2 point);
+    bool routes_initialized = false;
 };
 
 }; // namespace Tmpl8
\ No newline at end of file
@@ -16,7 +16,7 @@ Particle_beam::Particle_beam(vec2 min, vec2 max, Sprite* particle_beam_sprite, i
     rectangle = Rectangle2D(min_position, max_position);
 }
 
-void Particle_beam::tick(vector<Tank>& tanks)
+void Particle_beam::tick(TankPool& tanks)
 {
 
     if (++sprite_frame == 30)
@@ -25,15 +25,14 @@ void Particle_beam::tick(vector<Tank>& tanks)
     }
 }
 
-void Particle_beam::draw(Surface* screen)
+void Particle_beam::draw(RenderQueue& render_queue)
 {
     vec2 position = rectangle.min;
 
     const int offset_x = 23;
     const int offset_y = 137;
 
-    particle_beam_sprite->set_frame(sprite_frame / 10);
-    particle_beam_sprite->draw(screen, (int)(position.x - offset_x + HEALTHBAR_OFFSET), (int)(position.y - offset_y));
+    render_queue.add(particle_beam_sprite, sprite_frame / 10, (int)(position.x - offset_x + HEALTHBAR_OFFSET), (int)(position.y - offset_y));
 }
 
 } // namespace Tmpl8
\ No newline at end of file
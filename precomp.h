@@ -15,6 +15,8 @@
 // #define FULLSCREEN
 // #define ADVANCEDGL	// faster if your system supports it
 
+// HEADLESS builds (the benchmark target) have no window, so they don't need OpenGL or SDL
+#ifndef HEADLESS
 // Glew should be included first
 #include <GL/glew.h>
 // Comment for autoformatters: prevent reordering these two.
@@ -28,15 +30,18 @@
 // header WIN32_LEAN_AND_MEAN, unless it was already imported.
 #include <GL/wglext.h>
 
+#endif
 #endif
 
 // External dependencies:
 #include <FreeImage.h>
 
+#ifndef HEADLESS
 #pragma warning(push)
 #pragma warning(disable : 26812)
 #include <SDL.h>
 #pragma warning(pop)
+#endif
 
 // C++ headers
 #include <algorithm>
@@ -53,9 +58,12 @@
 
 #include <deque>
 #include <queue>
+#include <unordered_map>
+#include <unordered_set>
 #include <future>
 #include <mutex>
 #include <thread>
+#include <atomic>
 #include <filesystem>
 
 // Namespaced C headers:
@@ -64,11 +72,16 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 // Header for AVX, and every technology before it.
 // If your CPU does not support this, include the appropriate header instead.
 // See: https://stackoverflow.com/a/11228864/2844473
 #include <immintrin.h>
+#ifdef _MSC_VER
+// __cpuid and _xgetbv, for picking kernels by CPU features at runtime
+#include <intrin.h>
+#endif
 
 // clang-format off
 
@@ -82,7 +95,11 @@ using namespace std;
 using namespace Tmpl8;
 
 #include "thread_pool.h"
+#include "spatial_grid.h"
+#include "profiler.h"
+#include "render_queue.h"
 
+#include "route_hierarchy.h"
 #include "tank.h"
 #include "terrain.h"
 #include "rocket.h"
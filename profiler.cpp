@@ -0,0 +1,75 @@
+#include "precomp.h"
+#include "profiler.h"
+
+namespace Tmpl8
+{
+
+Profiler frame_profiler;
+
+int Profiler::register_zone(const char* name)
+{
+    return register_zone(name, false);
+}
+
+int Profiler::register_counter(const char* name)
+{
+    return register_zone(name, true);
+}
+
+int Profiler::register_zone(const char* name, bool is_counter)
+{
+    for (size_t i = 0; i < zones.size(); i++)
+    {
+        if (strcmp(zones[i].name, name) == 0) return (int)i;
+    }
+
+    //Frames recorded before the zone existed count as zero
+    zones.push_back(Zone{ name, 0.f, vector<float>(history_size, 0.f), is_counter });
+    return (int)zones.size() - 1;
+}
+
+void Profiler::end_frame()
+{
+    for (Zone& zone : zones)
+    {
+        zone.history[next_frame] = zone.current;
+        zone.current = 0.f;
+    }
+
+    next_frame = (next_frame + 1) % history_size;
+    recorded_frames = std::min(recorded_frames + 1, history_size);
+}
+
+void Profiler::print_summary() const
+{
+    printf("Profile over %zu frames (ms per frame)\n", recorded_frames);
+    print_zones(false);
+
+    if (std::any_of(zones.begin(), zones.end(), [](const Zone& zone) { return zone.is_counter; }))
+    {
+        printf("\nCounters (per frame)\n");
+        print_zones(true);
+    }
+}
+
+void Profiler::print_zones(bool counters) const
+{
+    printf("%-28s %10s %10s %10s %10s\n", counters ? "counter" : "zone", "min", "median", "p99", "max");
+
+    if (recorded_frames == 0) return;
+
+    vector<float> sorted(recorded_frames);
+    for (const Zone& zone : zones)
+    {
+        if (zone.is_counter != counters) continue;
+
+        //Until the ring buffer wraps the recorded frames are at the start
+        std::copy(zone.history.begin(), zone.history.begin() + recorded_frames, sorted.begin());
+        std::sort(sorted.begin(), sorted.end());
+
+        const size_t p99 = std::min(recorded_frames - 1, (size_t)ceilf(recorded_frames * 0.99f) - 1);
+        printf("%-28s %10.3f %10.3f %10.3f %10.3f\n", zone.name, sorted.front(), sorted[recorded_frames / 2], sorted[p99], sorted.back());
+    }
+}
+
+} // namespace Tmpl8
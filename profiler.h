@@ -0,0 +1,77 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Collects the time spent in named zones per frame, and per-frame totals of named counters (like bytes written)
+//Values are summed during a frame, end_frame() stores them in a ring buffer per zone
+class Profiler
+{
+  public:
+    //Enough frames to hold a full max_frames run
+    static constexpr size_t history_size = 2048;
+
+    //Returns the id of the zone with this name, adding it if it doesn't exist yet
+    int register_zone(const char* name);
+
+    //Same for a counter, counters are added to like zones but printed in their own table
+    int register_counter(const char* name);
+
+    void add(int zone, float milliseconds) { zones[zone].current += milliseconds; }
+    void end_frame();
+
+    //Prints min/median/p99/max milliseconds per frame of every zone over the recorded frames
+    //(max shows one-off work like the route calculation in the first frame)
+    void print_summary() const;
+
+  private:
+    struct Zone
+    {
+        const char* name;
+        float current;
+        vector<float> history;
+        bool is_counter;
+    };
+
+    int register_zone(const char* name, bool is_counter);
+    void print_zones(bool counters) const;
+
+    vector<Zone> zones;
+
+    size_t next_frame = 0;
+    size_t recorded_frames = 0;
+};
+
+//Adds the time between construction and destruction to a zone
+class ScopedTimer
+{
+  public:
+    ScopedTimer(Profiler& profiler, int zone) : profiler(profiler), zone(zone) {}
+    ~ScopedTimer() { profiler.add(zone, zone_timer.elapsed()); }
+
+  private:
+    Profiler& profiler;
+    int zone;
+    timer zone_timer;
+};
+
+//Global profiler used by the PROFILE_SCOPE zones
+extern Profiler frame_profiler;
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+//Times the rest of the enclosing scope as zone "name"
+#define PROFILE_SCOPE(name)                                                                             \
+    static const int PROFILE_CONCAT(profile_zone_, __LINE__) = frame_profiler.register_zone(name); \
+    ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)(frame_profiler, PROFILE_CONCAT(profile_zone_, __LINE__))
+
+//Adds amount to counter "name" for this frame
+#define PROFILE_COUNT(name, amount)                                                                         \
+    do                                                                                                      \
+    {                                                                                                       \
+        static const int PROFILE_CONCAT(profile_counter_, __LINE__) = frame_profiler.register_counter(name); \
+        frame_profiler.add(PROFILE_CONCAT(profile_counter_, __LINE__), (float)(amount));                  \
+    } while (0)
+
+} // namespace Tmpl8
@@ -0,0 +1,131 @@
+#include "precomp.h"
+#include "render_queue.h"
+
+namespace Tmpl8
+{
+
+void RenderQueue::begin_layer()
+{
+    layer_sprites.clear();
+}
+
+void RenderQueue::add(Sprite* sprite, unsigned int frame, int x, int y)
+{
+    //A layer only uses a handful of sprites, usually just one
+    size_t index = 0;
+    while (index < layer_sprites.size() && layer_sprites[index].first != sprite) index++;
+
+    if (index == layer_sprites.size())
+    {
+        layer_sprites.push_back({ sprite, (uint32_t)buckets.size() });
+        for (unsigned int i = 0; i < sprite->frames(); i++) buckets.push_back({ sprite, i });
+        bucket_counts.resize(buckets.size(), 0);
+    }
+
+    const uint32_t bucket = layer_sprites[index].second + frame;
+    bucket_counts[bucket]++;
+    commands.push_back({ bucket, x, y });
+}
+
+void RenderQueue::submit(Surface* target)
+{
+    sort();
+
+    //Every bucket ends where the next one starts now
+    size_t begin = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); bucket++)
+    {
+        const size_t end = bucket_counts[bucket];
+        if (begin == end) continue;
+
+        Sprite* sprite = buckets[bucket].sprite;
+        sprite->set_frame(buckets[bucket].frame);
+        for (size_t i = begin; i < end; i++)
+        {
+            sprite->draw(target, sorted[i].x, sorted[i].y);
+        }
+        begin = end;
+    }
+
+    clear();
+}
+
+void RenderQueue::submit(Surface* target, ThreadPool& pool)
+{
+    sort();
+
+    const int height = target->get_height();
+    const size_t num_tiles = (height + tile_height - 1) / tile_height;
+
+    //Bins the draws in two passes, count per tile first and then fill in the sorted order
+    tile_starts.assign(num_tiles + 1, 0);
+    for (const Command& command : sorted)
+    {
+        const int y1 = std::max(command.y, 0);
+        const int y2 = std::min(command.y + buckets[command.bucket].sprite->get_height(), height);
+        if (y2 <= y1) continue;
+
+        for (int tile = y1 / tile_height; tile <= (y2 - 1) / tile_height; tile++) tile_starts[tile + 1]++;
+    }
+    for (size_t tile = 0; tile < num_tiles; tile++) tile_starts[tile + 1] += tile_starts[tile];
+
+    tile_commands.resize(tile_starts[num_tiles]);
+    for (uint32_t i = 0; i < (uint32_t)sorted.size(); i++)
+    {
+        const Command& command = sorted[i];
+        const int y1 = std::max(command.y, 0);
+        const int y2 = std::min(command.y + buckets[command.bucket].sprite->get_height(), height);
+        if (y2 <= y1) continue;
+
+        for (int tile = y1 / tile_height; tile <= (y2 - 1) / tile_height; tile++) tile_commands[tile_starts[tile]++] = i;
+    }
+
+    //Filling moved every start to the next tile, the first tile starts at 0 again
+    for (size_t tile = num_tiles; tile > 0; tile--) tile_starts[tile] = tile_starts[tile - 1];
+    tile_starts[0] = 0;
+
+    pool.parallel_for(num_tiles, 1, [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++)
+        {
+            const int tile_y1 = (int)tile * tile_height;
+            const int tile_y2 = tile_y1 + tile_height;
+            for (uint32_t i = tile_starts[tile]; i < tile_starts[tile + 1]; i++)
+            {
+                const Command& command = sorted[tile_commands[i]];
+                const Bucket& bucket = buckets[command.bucket];
+                bucket.sprite->draw_rows(target, bucket.frame, command.x, command.y, tile_y1, tile_y2);
+            }
+        }
+    });
+
+    clear();
+}
+
+//Stable counting sort on the bucket into sorted, leaves the end of every bucket in bucket_counts
+void RenderQueue::sort()
+{
+    //Turn the counts into the first slot of every bucket first
+    uint32_t first = 0;
+    for (uint32_t& count : bucket_counts)
+    {
+        const uint32_t bucket_size = count;
+        count = first;
+        first += bucket_size;
+    }
+
+    sorted.resize(commands.size());
+    for (const Command& command : commands)
+    {
+        sorted[bucket_counts[command.bucket]++] = command;
+    }
+}
+
+void RenderQueue::clear()
+{
+    layer_sprites.clear();
+    buckets.clear();
+    bucket_counts.clear();
+    commands.clear();
+}
+
+} // namespace Tmpl8
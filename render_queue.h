@@ -0,0 +1,59 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Collects sprite draws for a frame and draws them in one pass
+//Layers are drawn in the order they were begun, within a layer draws are grouped by sprite and frame
+//(in the order they were added otherwise), so consecutive draws read the same pixels and spans
+class RenderQueue
+{
+  public:
+    //Rows of the screen tiles the parallel submit draws independently
+    static constexpr int tile_height = 16;
+
+    //Draws added from now on go on top of everything added before
+    void begin_layer();
+
+    void add(Sprite* sprite, unsigned int frame, int x, int y);
+
+    //Draws everything and empties the queue
+    void submit(Surface* target);
+
+    //Same result as submit(target), but the draws are binned per tile of full rows and the tiles are drawn in parallel
+    //Every tile only writes its own rows and draws its bin in submission order, so no pixel is shared between threads
+    void submit(Surface* target, ThreadPool& pool);
+
+  private:
+    //Every frame of every sprite used in a layer gets a bucket, buckets of later layers come after those of earlier ones
+    //so sorting the draws on their bucket keeps the layer order
+    struct Bucket
+    {
+        Sprite* sprite;
+        unsigned int frame;
+    };
+
+    struct Command
+    {
+        uint32_t bucket;
+        int x;
+        int y;
+    };
+
+    void sort();
+    void clear();
+
+    //Sprites of the current layer and their first bucket
+    vector<std::pair<Sprite*, uint32_t>> layer_sprites;
+
+    vector<Bucket> buckets;
+    vector<uint32_t> bucket_counts;
+    vector<Command> commands;
+    vector<Command> sorted;
+
+    //Sorted draws that touch each tile, those of tile i are tile_commands[tile_starts[i]] up to tile_commands[tile_starts[i + 1]]
+    vector<uint32_t> tile_starts;
+    vector<uint32_t> tile_commands;
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,439 @@
+#include "precomp.h"
+#include "route_hierarchy.h"
+
+namespace Tmpl8
+{
+    //Passable border stretches at least this long get an entrance at both ends instead of one in the middle
+    static constexpr size_t min_wide_entrance = 6;
+
+    void RouteHierarchy::reset(size_t map_width, size_t map_height)
+    {
+        width = map_width;
+        height = map_height;
+        clusters_x = (width + cluster_size - 1) / cluster_size;
+        clusters_y = (height + cluster_size - 1) / cluster_size;
+
+        clusters.clear();
+        clusters.resize(clusters_x * clusters_y);
+        tile_nodes.assign(width * height, no_node);
+        any_dirty = true;
+    }
+
+    void RouteHierarchy::invalidate(size_t x, size_t y)
+    {
+        clusters[(y / cluster_size) * clusters_x + x / cluster_size].dirty = true;
+        any_dirty = true;
+    }
+
+    bool RouteHierarchy::find_route(const Terrain& terrain, size_t start_x, size_t start_y, size_t target_x, size_t target_y, RouteSearch& search, vector<vec2>& route)
+    {
+        route.clear();
+        update(terrain, search);
+
+        const uint32_t start = (uint32_t)(start_y * width + start_x);
+        const uint32_t goal = (uint32_t)(target_y * width + target_x);
+
+        if (terrain.get_tile_cost(goal) == 0)
+        {
+            return false;
+        }
+
+        //Tanks can get pushed onto inaccessible tiles, which have no entrances, so route from the cheapest neighbour instead
+        if (start != goal && terrain.get_tile_cost(start) == 0)
+        {
+            bool tried[4] = { false, false, false, false };
+            while (true)
+            {
+                int best_direction = -1;
+                uint32_t best_neighbour_cost = UINT32_MAX;
+                for (int d = 0; d < 4; d++)
+                {
+                    const int neighbour_x = (int)start_x + Terrain::directions[d][0];
+                    const int neighbour_y = (int)start_y + Terrain::directions[d][1];
+                    if (tried[d] || neighbour_x < 0 || neighbour_x >= (int)width || neighbour_y < 0 || neighbour_y >= (int)height) continue;
+
+                    const uint32_t cost = terrain.get_tile_cost(neighbour_y * width + neighbour_x);
+                    if (cost != 0 && cost < best_neighbour_cost)
+                    {
+                        best_direction = d;
+                        best_neighbour_cost = cost;
+                    }
+                }
+
+                if (best_direction < 0) break;
+                tried[best_direction] = true;
+
+                if (find_route(terrain, start_x + Terrain::directions[best_direction][0], start_y + Terrain::directions[best_direction][1], target_x, target_y, search, route))
+                {
+                    route.insert(route.begin(), vec2((float)start_x * Terrain::sprite_size, (float)start_y * Terrain::sprite_size));
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        const size_t start_cluster = get_cluster(start);
+        const size_t goal_cluster = get_cluster(goal);
+        const Cluster& first = clusters[start_cluster];
+        const Cluster& last = clusters[goal_cluster];
+
+        //Connect the start to the entrances of its cluster, and the entrances of the goal cluster to the goal
+        search_cluster(terrain, start, false, search);
+        search.start_costs.resize(first.nodes.size());
+        for (size_t i = 0; i < first.nodes.size(); i++)
+        {
+            search.start_costs[i] = search.cluster_cost[get_local_index(first.nodes[i].tile)];
+        }
+
+        //Staying inside the cluster may be the cheapest way when both are in the same one
+        uint32_t best_cost = (start_cluster == goal_cluster) ? search.cluster_cost[get_local_index(goal)] : UINT32_MAX;
+        uint32_t best_parent = no_tile;
+
+        search_cluster(terrain, goal, true, search);
+        search.goal_costs.resize(last.nodes.size());
+        for (size_t i = 0; i < last.nodes.size(); i++)
+        {
+            search.goal_costs[i] = search.cluster_cost[get_local_index(last.nodes[i].tile)];
+        }
+
+        //A* over the entrances, keyed by tile so the tile buffers of the search can be used
+        search.begin(width * height);
+        search.open.clear();
+
+        auto heuristic = [&](uint32_t tile) {
+            const int dx = std::abs((int)(tile % width) - (int)target_x);
+            const int dy = std::abs((int)(tile / width) - (int)target_y);
+            return (uint32_t)(dx + dy) * Terrain::min_tile_cost;
+        };
+
+        auto relax = [&](uint32_t tile, uint32_t parent, uint32_t cost) {
+            if (search.visited[tile] != search.generation || cost < search.cost[tile])
+            {
+                search.visited[tile] = search.generation;
+                search.cost[tile] = cost;
+                search.parent[tile] = parent;
+
+                search.open.push_back({ cost + heuristic(tile), tile });
+                std::push_heap(search.open.begin(), search.open.end(), std::greater<>());
+            }
+        };
+
+        for (size_t i = 0; i < first.nodes.size(); i++)
+        {
+            if (search.start_costs[i] != UINT32_MAX)
+            {
+                relax(first.nodes[i].tile, no_tile, search.start_costs[i]);
+            }
+        }
+
+        while (!search.open.empty())
+        {
+            std::pop_heap(search.open.begin(), search.open.end(), std::greater<>());
+            const std::pair<uint32_t, uint32_t> entry = search.open.back();
+            search.open.pop_back();
+
+            //Nothing left that can beat the best route to the goal
+            if (entry.first >= best_cost) break;
+
+            const uint32_t current = entry.second;
+            if (search.closed[current] == search.generation) continue;
+            search.closed[current] = search.generation;
+
+            const size_t cluster_index = get_cluster(current);
+            const Cluster& cluster = clusters[cluster_index];
+            const size_t node_index = tile_nodes[current];
+            const Node& node = cluster.nodes[node_index];
+            const uint32_t cost = search.cost[current];
+
+            if (cluster_index == goal_cluster && search.goal_costs[node_index] != UINT32_MAX && cost + search.goal_costs[node_index] < best_cost)
+            {
+                best_cost = cost + search.goal_costs[node_index];
+                best_parent = current;
+            }
+
+            //Other entrances of the same cluster
+            const size_t num_nodes = cluster.nodes.size();
+            for (size_t j = 0; j < num_nodes; j++)
+            {
+                const uint32_t edge_cost = cluster.costs[node_index * num_nodes + j];
+                if (j != node_index && edge_cost != UINT32_MAX)
+                {
+                    relax(cluster.nodes[j].tile, current, cost + edge_cost);
+                }
+            }
+
+            //Across the border
+            for (uint8_t p = 0; p < node.num_partners; p++)
+            {
+                relax(node.partners[p], current, cost + terrain.get_tile_cost(node.partners[p]));
+            }
+        }
+
+        if (best_cost == UINT32_MAX)
+        {
+            return false;
+        }
+
+        //Abstract route from start to goal
+        vector<uint32_t>& waypoints = search.waypoints;
+        waypoints.clear();
+        waypoints.push_back(goal);
+        for (uint32_t tile = best_parent; tile != no_tile; tile = search.parent[tile])
+        {
+            waypoints.push_back(tile);
+        }
+        waypoints.push_back(start);
+        std::reverse(waypoints.begin(), waypoints.end());
+
+        //Steps across a border are single tiles, only the parts within a cluster need a search
+        route.push_back(vec2((float)start_x * Terrain::sprite_size, (float)start_y * Terrain::sprite_size));
+        for (size_t i = 1; i < waypoints.size(); i++)
+        {
+            const uint32_t from = waypoints[i - 1];
+            const uint32_t to = waypoints[i];
+            if (from == to) continue;
+
+            const size_t cluster_index = get_cluster(from);
+            if (cluster_index != get_cluster(to))
+            {
+                route.push_back(vec2((float)(to % width) * Terrain::sprite_size, (float)(to / width) * Terrain::sprite_size));
+                continue;
+            }
+
+            if (!terrain.find_route(from % width, from / width, to % width, to / width, get_bounds(cluster_index), search, search.segment))
+            {
+                route.clear();
+                return false;
+            }
+            route.insert(route.end(), search.segment.begin() + 1, search.segment.end());
+        }
+
+        return true;
+    }
+
+    //Rebuilds the borders and entrances around every cluster that changed
+    void RouteHierarchy::update(const Terrain& terrain, RouteSearch& search)
+    {
+        if (!any_dirty) return;
+
+        auto is_dirty = [&](size_t x, size_t y) {
+            return x < clusters_x && y < clusters_y && clusters[y * clusters_x + x].dirty;
+        };
+
+        //A cluster owns its east and south border, the west and north ones belong to the neighbours
+        for (size_t y = 0; y < clusters_y; y++)
+        {
+            for (size_t x = 0; x < clusters_x; x++)
+            {
+                if (is_dirty(x, y) || is_dirty(x + 1, y) || is_dirty(x, y + 1))
+                {
+                    build_entrances(terrain, x, y);
+                }
+            }
+        }
+
+        //Changed borders change the entrances on both sides (x - 1 wraps around to a value that is out of range)
+        for (size_t y = 0; y < clusters_y; y++)
+        {
+            for (size_t x = 0; x < clusters_x; x++)
+            {
+                if (is_dirty(x, y) || is_dirty(x - 1, y) || is_dirty(x + 1, y) || is_dirty(x, y - 1) || is_dirty(x, y + 1))
+                {
+                    build_nodes(terrain, x, y, search);
+                }
+            }
+        }
+
+        for (Cluster& cluster : clusters)
+        {
+            cluster.dirty = false;
+        }
+        any_dirty = false;
+    }
+
+    //Every maximal stretch of border where tiles on both sides are accessible gets one or two entrances
+    void RouteHierarchy::build_entrances(const Terrain& terrain, size_t cluster_x, size_t cluster_y)
+    {
+        const size_t cluster_index = cluster_y * clusters_x + cluster_x;
+        Cluster& cluster = clusters[cluster_index];
+        const TileBounds bounds = get_bounds(cluster_index);
+
+        //Adds the entrances of the stretch [begin, end) along a border, tile(i) gives the tile pair at position i
+        auto add_stretch = [&](vector<std::pair<uint32_t, uint32_t>>& entrances, size_t begin, size_t end, auto tile) {
+            if (begin == end) return;
+
+            if (end - begin < min_wide_entrance)
+            {
+                entrances.push_back(tile(begin + (end - begin) / 2));
+            }
+            else
+            {
+                entrances.push_back(tile(begin));
+                entrances.push_back(tile(end - 1));
+            }
+        };
+
+        cluster.east.clear();
+        if (cluster_x + 1 < clusters_x)
+        {
+            const size_t x = bounds.max_x - 1;
+            auto tile = [&](size_t y) { return std::make_pair((uint32_t)(y * width + x), (uint32_t)(y * width + x + 1)); };
+
+            size_t begin = bounds.min_y;
+            for (size_t y = bounds.min_y; y < bounds.max_y; y++)
+            {
+                if (terrain.get_tile_cost(y * width + x) == 0 || terrain.get_tile_cost(y * width + x + 1) == 0)
+                {
+                    add_stretch(cluster.east, begin, y, tile);
+                    begin = y + 1;
+                }
+            }
+            add_stretch(cluster.east, begin, bounds.max_y, tile);
+        }
+
+        cluster.south.clear();
+        if (cluster_y + 1 < clusters_y)
+        {
+            const size_t y = bounds.max_y - 1;
+            auto tile = [&](size_t x) { return std::make_pair((uint32_t)(y * width + x), (uint32_t)((y + 1) * width + x)); };
+
+            size_t begin = bounds.min_x;
+            for (size_t x = bounds.min_x; x < bounds.max_x; x++)
+            {
+                if (terrain.get_tile_cost(y * width + x) == 0 || terrain.get_tile_cost((y + 1) * width + x) == 0)
+                {
+                    add_stretch(cluster.south, begin, x, tile);
+                    begin = x + 1;
+                }
+            }
+            add_stretch(cluster.south, begin, bounds.max_x, tile);
+        }
+    }
+
+    //Collects the entrance tiles on all four borders and the cheapest routes between them inside the cluster
+    void RouteHierarchy::build_nodes(const Terrain& terrain, size_t cluster_x, size_t cluster_y, RouteSearch& search)
+    {
+        const size_t cluster_index = cluster_y * clusters_x + cluster_x;
+        Cluster& cluster = clusters[cluster_index];
+
+        for (const Node& node : cluster.nodes)
+        {
+            tile_nodes[node.tile] = no_node;
+        }
+        cluster.nodes.clear();
+
+        for (const auto& entrance : cluster.east)
+        {
+            add_node(cluster, entrance.first, entrance.second);
+        }
+        for (const auto& entrance : cluster.south)
+        {
+            add_node(cluster, entrance.first, entrance.second);
+        }
+        if (cluster_x > 0)
+        {
+            for (const auto& entrance : clusters[cluster_index - 1].east)
+            {
+                add_node(cluster, entrance.second, entrance.first);
+            }
+        }
+        if (cluster_y > 0)
+        {
+            for (const auto& entrance : clusters[cluster_index - clusters_x].south)
+            {
+                add_node(cluster, entrance.second, entrance.first);
+            }
+        }
+
+        const size_t num_nodes = cluster.nodes.size();
+        cluster.costs.assign(num_nodes * num_nodes, UINT32_MAX);
+        for (size_t i = 0; i < num_nodes; i++)
+        {
+            search_cluster(terrain, cluster.nodes[i].tile, false, search);
+            for (size_t j = 0; j < num_nodes; j++)
+            {
+                cluster.costs[i * num_nodes + j] = search.cluster_cost[get_local_index(cluster.nodes[j].tile)];
+            }
+        }
+    }
+
+    void RouteHierarchy::add_node(Cluster& cluster, uint32_t tile, uint32_t partner)
+    {
+        if (tile_nodes[tile] == no_node)
+        {
+            tile_nodes[tile] = (uint16_t)cluster.nodes.size();
+            cluster.nodes.push_back(Node{ tile, { no_tile, no_tile }, 0 });
+        }
+
+        Node& node = cluster.nodes[tile_nodes[tile]];
+        node.partners[node.num_partners++] = partner;
+    }
+
+    void RouteHierarchy::search_cluster(const Terrain& terrain, uint32_t tile, bool reversed, RouteSearch& search) const
+    {
+        const TileBounds bounds = get_bounds(get_cluster(tile));
+
+        vector<uint32_t>& cost = search.cluster_cost;
+        cost.assign(cluster_size * cluster_size, UINT32_MAX);
+
+        search.open.clear();
+        search.open.push_back({ 0, tile });
+        cost[get_local_index(tile)] = 0;
+
+        while (!search.open.empty())
+        {
+            std::pop_heap(search.open.begin(), search.open.end(), std::greater<>());
+            const uint32_t current_cost = search.open.back().first;
+            const uint32_t current = search.open.back().second;
+            search.open.pop_back();
+
+            //Stale entry, the tile was reached more cheaply in the meantime
+            if (current_cost != cost[get_local_index(current)]) continue;
+
+            //Reversed, neighbours step onto this tile, which only accessible tiles allow
+            if (reversed && terrain.get_tile_cost(current) == 0) continue;
+
+            const int x = (int)(current % width);
+            const int y = (int)(current / width);
+            for (uint8_t d = 0; d < 4; d++)
+            {
+                const int neighbour_x = x + Terrain::directions[d][0];
+                const int neighbour_y = y + Terrain::directions[d][1];
+                if (neighbour_x < (int)bounds.min_x || neighbour_x >= (int)bounds.max_x || neighbour_y < (int)bounds.min_y || neighbour_y >= (int)bounds.max_y)
+                {
+                    continue;
+                }
+
+                const uint32_t neighbour = (uint32_t)(neighbour_y * width + neighbour_x);
+                const uint32_t step_cost = terrain.get_tile_cost(reversed ? current : neighbour);
+                if (step_cost == 0) continue;
+
+                const size_t local = get_local_index(neighbour);
+                if (current_cost + step_cost < cost[local])
+                {
+                    cost[local] = current_cost + step_cost;
+                    search.open.push_back({ cost[local], neighbour });
+                    std::push_heap(search.open.begin(), search.open.end(), std::greater<>());
+                }
+            }
+        }
+    }
+
+    size_t RouteHierarchy::get_cluster(uint32_t tile) const
+    {
+        return ((tile / width) / cluster_size) * clusters_x + (tile % width) / cluster_size;
+    }
+
+    size_t RouteHierarchy::get_local_index(uint32_t tile) const
+    {
+        return ((tile / width) % cluster_size) * cluster_size + (tile % width) % cluster_size;
+    }
+
+    TileBounds RouteHierarchy::get_bounds(size_t cluster) const
+    {
+        const size_t min_x = (cluster % clusters_x) * cluster_size;
+        const size_t min_y = (cluster / clusters_x) * cluster_size;
+        return TileBounds{ min_x, min_y, std::min(min_x + cluster_size, width), std::min(min_y + cluster_size, height) };
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+namespace Tmpl8
+{
+    class Terrain; //Forward declare
+    struct RouteSearch;
+    struct TileBounds;
+
+    //Hierarchical route planning (HPA*) for maps that are too large for a search over every tile
+    //The map is cut into square clusters, tiles on both sides of a passable stretch of cluster border become entrances
+    //and the cheapest routes between the entrances of a cluster are stored, so a route is first planned over entrances only
+    //Only the parts of that abstract route that lie inside a cluster are searched tile by tile afterwards
+    class RouteHierarchy
+    {
+    public:
+        static constexpr size_t cluster_size = 16;
+
+        //Drops everything, the clusters are built on the first route
+        void reset(size_t map_width, size_t map_height);
+
+        //The tile changed, rebuilds its cluster and the borders around it before the next route
+        void invalidate(size_t x, size_t y);
+
+        //Cheapest route over the entrances between two tiles, empty if there is none
+        bool find_route(const Terrain& terrain, size_t start_x, size_t start_y, size_t target_x, size_t target_y, RouteSearch& search, vector<vec2>& route);
+
+    private:
+        static constexpr uint16_t no_node = 0xffff;
+        static constexpr uint32_t no_tile = UINT32_MAX;
+
+        //Entrance tile, partners are the tiles on the other side of the border it can step to (at most one horizontal and one vertical)
+        struct Node
+        {
+            uint32_t tile;
+            uint32_t partners[2];
+            uint8_t num_partners;
+        };
+
+        struct Cluster
+        {
+            vector<Node> nodes;
+            vector<uint32_t> costs; //Cheapest route inside the cluster from node i to node j at i * nodes.size() + j, UINT32_MAX if there is none
+
+            //Entrances on the east and south border as (tile in this cluster, tile in the neighbour)
+            vector<std::pair<uint32_t, uint32_t>> east;
+            vector<std::pair<uint32_t, uint32_t>> south;
+
+            bool dirty = true;
+        };
+
+        void update(const Terrain& terrain, RouteSearch& search);
+        void build_entrances(const Terrain& terrain, size_t cluster_x, size_t cluster_y);
+        void build_nodes(const Terrain& terrain, size_t cluster_x, size_t cluster_y, RouteSearch& search);
+        void add_node(Cluster& cluster, uint32_t tile, uint32_t partner);
+
+        //Dijkstra from the tile to every tile of its cluster, into search.cluster_cost by position within the cluster
+        //Reversed it gives the cost from every tile of the cluster to the given tile instead
+        void search_cluster(const Terrain& terrain, uint32_t tile, bool reversed, RouteSearch& search) const;
+
+        size_t get_cluster(uint32_t tile) const;
+        size_t get_local_index(uint32_t tile) const;
+        TileBounds get_bounds(size_t cluster) const;
+
+        size_t width = 0;
+        size_t height = 0;
+        size_t clusters_x = 0;
+        size_t clusters_y = 0;
+        bool any_dirty = false;
+
+        vector<Cluster> clusters;
+        vector<uint16_t> tile_nodes; //Node index of each tile within its cluster, no_node for tiles that aren't entrances
+    };
+}
@@ -9,11 +9,9 @@ void Smoke::tick()
     if (++current_frame == 60) current_frame = 0;
 }
 
-void Smoke::draw(Surface* screen)
+void Smoke::draw(RenderQueue& render_queue)
 {
-    smoke_sprite.set_frame(current_frame / 15);
-
-    smoke_sprite.draw(screen, (int)position.x + HEALTHBAR_OFFSET, (int)position.y);
+    render_queue.add(&smoke_sprite, current_frame / 15, (int)position.x + HEALTHBAR_OFFSET, (int)position.y);
 }
 
 } // namespace Tmpl8
\ No newline at end of file
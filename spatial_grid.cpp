@@ -0,0 +1,131 @@
+#include "precomp.h"
+#include "spatial_grid.h"
+
+namespace Tmpl8
+{
+
+SpatialGrid::SpatialGrid(float cell_size, float world_width, float world_height)
+    : cell_size(cell_size),
+      inv_cell_size(1.f / cell_size),
+      num_cells_x(std::max(1, (int)ceilf(world_width / cell_size))),
+      num_cells_y(std::max(1, (int)ceilf(world_height / cell_size)))
+{
+    cell_start.resize((size_t)num_cells_x * num_cells_y + 1, 0);
+}
+
+void SpatialGrid::clear()
+{
+    pending.clear();
+}
+
+//Positions outside of the world are stored in the nearest border cell
+void SpatialGrid::add(int index, const vec2& position)
+{
+    pending.push_back({ cell_y(position.y) * num_cells_x + cell_x(position.x), index, position });
+}
+
+//Counting sort of the pending entries into their cells
+void SpatialGrid::build()
+{
+    std::fill(cell_start.begin(), cell_start.end(), 0);
+
+    for (const auto& entry : pending)
+    {
+        cell_start[entry.cell + 1]++;
+    }
+
+    for (size_t c = 1; c < cell_start.size(); c++)
+    {
+        cell_start[c] += cell_start[c - 1];
+    }
+
+    cell_entries.resize(pending.size());
+    cell_positions.resize(pending.size());
+
+    //Use the cell start as a write cursor, this leaves it at the start of the next cell so shift it back afterwards
+    for (const auto& entry : pending)
+    {
+        const int slot = cell_start[entry.cell]++;
+        cell_entries[slot] = entry.index;
+        cell_positions[slot] = entry.position;
+    }
+    for (size_t c = cell_start.size() - 1; c > 0; c--)
+    {
+        cell_start[c] = cell_start[c - 1];
+    }
+    cell_start[0] = 0;
+}
+
+void SpatialGrid::query(const vec2& position, float radius, vector<int>& result) const
+{
+    const int min_x = cell_x(position.x - radius);
+    const int max_x = cell_x(position.x + radius);
+    const int min_y = cell_y(position.y - radius);
+    const int max_y = cell_y(position.y + radius);
+
+    for (int y = min_y; y <= max_y; y++)
+    {
+        //Cells in a row are contiguous so the whole span can be copied at once
+        const int row = y * num_cells_x;
+        result.insert(result.end(), cell_entries.begin() + cell_start[row + min_x], cell_entries.begin() + cell_start[row + max_x + 1]);
+    }
+}
+
+//Expanding ring search around the cell containing position
+int SpatialGrid::find_nearest(const vec2& position) const
+{
+    if (cell_entries.empty()) return -1;
+
+    const int center_x = cell_x(position.x);
+    const int center_y = cell_y(position.y);
+    const int max_ring = std::max(num_cells_x, num_cells_y);
+
+    float closest_distance = numeric_limits<float>::infinity();
+    int closest_index = -1;
+
+    for (int ring = 0; ring <= max_ring; ring++)
+    {
+        //Entries in this ring or beyond are at least (ring - 1) whole cells away, stop if those can't win
+        //(strictly less, so an equally distant entry with a lower index is still found)
+        const float ring_distance = (ring - 1) * cell_size;
+        if (closest_index >= 0 && ring > 0 && closest_distance < ring_distance * ring_distance) break;
+
+        for (int y = center_y - ring; y <= center_y + ring; y++)
+        {
+            if (y < 0 || y >= num_cells_y) continue;
+
+            //The top and bottom rows of a ring are complete, the rows in between only have their two side cells
+            const int step = (y == center_y - ring || y == center_y + ring) ? 1 : 2 * ring;
+
+            for (int x = center_x - ring; x <= center_x + ring; x += step)
+            {
+                if (x < 0 || x >= num_cells_x) continue;
+
+                const int cell = y * num_cells_x + x;
+                for (int e = cell_start[cell]; e < cell_start[cell + 1]; e++)
+                {
+                    const float sqr_dist = (cell_positions[e] - position).sqr_length();
+                    if (sqr_dist < closest_distance || (sqr_dist == closest_distance && cell_entries[e] < closest_index))
+                    {
+                        closest_distance = sqr_dist;
+                        closest_index = cell_entries[e];
+                    }
+                }
+            }
+        }
+    }
+
+    return closest_index;
+}
+
+int SpatialGrid::cell_x(float x) const
+{
+    return clamp((int)floorf(x * inv_cell_size), 0, num_cells_x - 1);
+}
+
+int SpatialGrid::cell_y(float y) const
+{
+    return clamp((int)floorf(y * inv_cell_size), 0, num_cells_y - 1);
+}
+
+} // namespace Tmpl8
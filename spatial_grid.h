@@ -0,0 +1,50 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+//Uniform grid that buckets indices by position, rebuilt every frame with a counting sort
+//Entries within a cell keep the order in which they were added
+class SpatialGrid
+{
+  public:
+    SpatialGrid() = default;
+    SpatialGrid(float cell_size, float world_width, float world_height);
+
+    void clear();
+    void add(int index, const vec2& position);
+    void build();
+
+    //Appends the indices of all entries in cells overlapping the square of size 2*radius around position
+    void query(const vec2& position, float radius, vector<int>& result) const;
+
+    //Returns the index of the entry closest to position (ties go to the lowest index), or -1 if the grid is empty
+    int find_nearest(const vec2& position) const;
+
+  private:
+    int cell_x(float x) const;
+    int cell_y(float y) const;
+
+    float cell_size = 1.f;
+    float inv_cell_size = 1.f;
+
+    int num_cells_x = 0;
+    int num_cells_y = 0;
+
+    struct Entry
+    {
+        int cell;
+        int index;
+        vec2 position;
+    };
+
+    //Entries of cell c are cell_entries[cell_start[c] .. cell_start[c + 1])
+    vector<int> cell_start;
+    vector<int> cell_entries;
+    vector<vec2> cell_positions;
+
+    //Entries added since the last clear
+    vector<Entry> pending;
+};
+
+} // namespace Tmpl8
@@ -360,84 +360,214 @@ Sprite::Sprite(Surface* a_Surface, unsigned int a_NumFrames) : m_Width(a_Surface
                                                                m_NumFrames(a_NumFrames),
                                                                m_CurrentFrame(0),
                                                                m_Flags(0),
-                                                               m_Start(new unsigned int*[a_NumFrames]),
                                                                m_Surface(a_Surface)
 {
-    initialize_start_data();
+    initialize_span_data();
 }
 
 Sprite::~Sprite()
 {
-    for (unsigned int i = 0; i < m_NumFrames; i++) delete m_Start[i];
-    delete m_Start;
 }
 
-void Sprite::draw(Surface* a_Target, int a_X, int a_Y)
+// -----------------------------------------------------------
+// Span kernels for Sprite::draw and Surface::fill_row
+// Spans only hold opaque pixels, so a span is copied (or add blended) as a whole.
+// The AVX2 versions do 8 pixels at a time and a masked load/store for the
+// rest, the scalar versions are used on CPUs without AVX2.
+// -----------------------------------------------------------
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define TARGET_AVX2
+#define FORCE_INLINE __forceinline
+#endif
+
+struct ScalarSpanKernels
 {
-    //If out of screen skip
-    if ((a_X < -m_Width) || (a_X > (a_Target->get_width() + m_Width))) return;
-    if ((a_Y < -m_Height) || (a_Y > (a_Target->get_height() + m_Height))) return;
+    static void copy(Pixel* a_Dst, const Pixel* a_Src, int a_Count)
+    {
+        for (int x = 0; x < a_Count; x++) a_Dst[x] = a_Src[x];
+    }
 
-    //Get start and end points
-    int x1 = a_X, x2 = a_X + m_Width;
-    int y1 = a_Y, y2 = a_Y + m_Height;
+    static void add_blend(Pixel* a_Dst, const Pixel* a_Src, int a_Count)
+    {
+        for (int x = 0; x < a_Count; x++) a_Dst[x] = ::add_blend(a_Src[x], a_Dst[x]);
+    }
 
-    //Image start
-    Pixel* src = get_buffer() + m_CurrentFrame * m_Width;
-    //Set start x to within screen
-    if (x1 < 0)
+    static void fill(Pixel* a_Dst, Pixel a_Color, int a_Count)
     {
-        src += -x1;
-        x1 = 0;
+        for (int x = 0; x < a_Count; x++) a_Dst[x] = a_Color;
     }
-    //Set end x to within screen
-    if (x2 > a_Target->get_width()) x2 = a_Target->get_width();
-    if (y1 < 0)
+};
+
+struct Avx2SpanKernels
+{
+    //Lanes below a_Count set
+    TARGET_AVX2 static __m256i tail_mask(int a_Count)
+    {
+        return _mm256_cmpgt_epi32(_mm256_set1_epi32(a_Count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+
+    TARGET_AVX2 static void copy(Pixel* a_Dst, const Pixel* a_Src, int a_Count)
     {
-        src += -y1 * m_Pitch;
-        y1 = 0;
+        int x = 0;
+        for (; x + 8 <= a_Count; x += 8)
+        {
+            _mm256_storeu_si256((__m256i*)(a_Dst + x), _mm256_loadu_si256((const __m256i*)(a_Src + x)));
+        }
+        if (x < a_Count)
+        {
+            const __m256i mask = tail_mask(a_Count - x);
+            _mm256_maskstore_epi32((int*)(a_Dst + x), mask, _mm256_maskload_epi32((const int*)(a_Src + x), mask));
+        }
+    }
+
+    //add_blend is a saturating add of the red, green and blue bytes that leaves the top byte zero
+    TARGET_AVX2 static void add_blend(Pixel* a_Dst, const Pixel* a_Src, int a_Count)
+    {
+        const __m256i rgb = _mm256_set1_epi32(REDMASK | GREENMASK | BLUEMASK);
+        int x = 0;
+        for (; x + 8 <= a_Count; x += 8)
+        {
+            const __m256i src = _mm256_loadu_si256((const __m256i*)(a_Src + x));
+            const __m256i dst = _mm256_loadu_si256((const __m256i*)(a_Dst + x));
+            _mm256_storeu_si256((__m256i*)(a_Dst + x), _mm256_and_si256(_mm256_adds_epu8(src, dst), rgb));
+        }
+        if (x < a_Count)
+        {
+            const __m256i mask = tail_mask(a_Count - x);
+            const __m256i src = _mm256_maskload_epi32((const int*)(a_Src + x), mask);
+            const __m256i dst = _mm256_maskload_epi32((const int*)(a_Dst + x), mask);
+            _mm256_maskstore_epi32((int*)(a_Dst + x), mask, _mm256_and_si256(_mm256_adds_epu8(src, dst), rgb));
+        }
+    }
+
+    TARGET_AVX2 static void fill(Pixel* a_Dst, Pixel a_Color, int a_Count)
+    {
+        const __m256i color = _mm256_set1_epi32((int)a_Color);
+        int x = 0;
+        for (; x + 8 <= a_Count; x += 8)
+        {
+            _mm256_storeu_si256((__m256i*)(a_Dst + x), color);
+        }
+        if (x < a_Count)
+        {
+            _mm256_maskstore_epi32((int*)(a_Dst + x), tail_mask(a_Count - x), color);
+        }
     }
-    if (y2 > a_Target->get_height()) y2 = a_Target->get_height();
-    Pixel* dest = a_Target->get_buffer();
-    int xs;
-    const int dpitch = a_Target->get_pitch();
-    if ((x2 > x1) && (y2 > y1))
+};
+
+//The rows of a sprite frame that are on the target
+struct SpanRows
+{
+    const Pixel* src;               //First visible row of the frame
+    Pixel* dest;                    //Target row it goes to
+    const unsigned int* row_spans;  //Span offsets of the first visible row
+    const Sprite::Span* spans;
+    int rows;
+    int x;                          //Target x of the sprite
+    int x1, x2;                     //Visible part of the target
+    int src_pitch, dest_pitch;
+};
+
+//Only the opaque runs of each row are touched, transparent pixels are skipped without looking at them
+//Inlined into a function per kernel set, so the AVX2 kernels get inlined as well
+template <class Kernels>
+static FORCE_INLINE void draw_span_rows(const SpanRows& a_Rows, bool a_Flare)
+{
+    const Pixel* src = a_Rows.src;
+    Pixel* dest = a_Rows.dest;
+    for (int y = 0; y < a_Rows.rows; y++)
     {
-        unsigned int addr = y1 * dpitch + x1;
-        const int width = x2 - x1;
-        const int height = y2 - y1;
-        for (int y = 0; y < height; y++)
+        for (unsigned int i = a_Rows.row_spans[y]; i < a_Rows.row_spans[y + 1]; i++)
         {
-            const int line = y + (y1 - a_Y);
-            const int lsx = m_Start[m_CurrentFrame][line] + a_X;
-            if (m_Flags & FLARE)
+            const int xs = std::max(a_Rows.x + a_Rows.spans[i].start, a_Rows.x1);
+            const int xe = std::min(a_Rows.x + a_Rows.spans[i].end, a_Rows.x2);
+            if (xs >= xe) continue;
+
+            if (a_Flare)
             {
-                xs = (lsx > x1) ? lsx - x1 : 0;
-                for (int x = xs; x < width; x++)
-                {
-                    const Pixel c1 = *(src + x);
-                    if (c1 & 0xffffff)
-                    {
-                        const Pixel c2 = *(dest + addr + x);
-                        *(dest + addr + x) = add_blend(c1, c2);
-                    }
-                }
+                Kernels::add_blend(dest + xs, src + (xs - a_Rows.x), xe - xs);
             }
             else
             {
-                xs = (lsx > x1) ? lsx - x1 : 0;
-                for (int x = xs; x < width; x++)
-                {
-                    const Pixel c1 = *(src + x);
-                    if (c1 & 0xffffff) *(dest + addr + x) = c1;
-                }
+                Kernels::copy(dest + xs, src + (xs - a_Rows.x), xe - xs);
             }
-            addr += dpitch;
-            src += m_Pitch;
         }
+        src += a_Rows.src_pitch;
+        dest += a_Rows.dest_pitch;
     }
 }
 
+static void draw_span_rows_scalar(const SpanRows& a_Rows, bool a_Flare)
+{
+    draw_span_rows<ScalarSpanKernels>(a_Rows, a_Flare);
+}
+
+TARGET_AVX2 static void draw_span_rows_avx2(const SpanRows& a_Rows, bool a_Flare)
+{
+    draw_span_rows<Avx2SpanKernels>(a_Rows, a_Flare);
+}
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+
+    //The OS has to save the AVX registers as well
+    __cpuid(info, 1);
+    const bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+    if (!avx || (_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+void Surface::fill_row(int y, int x1, int split, int x2, Pixel left, Pixel right)
+{
+    static void (*const fill_span)(Pixel*, Pixel, int) = cpu_has_avx2() ? Avx2SpanKernels::fill : ScalarSpanKernels::fill;
+
+    Pixel* row = m_Buffer + y * m_Pitch;
+    fill_span(row + x1, left, split - x1);
+    fill_span(row + split, right, x2 - split);
+}
+
+void Sprite::draw(Surface* a_Target, int a_X, int a_Y)
+{
+    draw_rows(a_Target, m_CurrentFrame, a_X, a_Y, 0, a_Target->get_height());
+}
+
+void Sprite::draw_rows(Surface* a_Target, unsigned int a_Frame, int a_X, int a_Y, int a_Y1, int a_Y2) const
+{
+    static void (*const draw_span_rows)(const SpanRows&, bool) = cpu_has_avx2() ? draw_span_rows_avx2 : draw_span_rows_scalar;
+
+    //Get start and end points, clipped to the screen and the given rows
+    const int x1 = std::max(a_X, 0);
+    const int x2 = std::min(a_X + m_Width, a_Target->get_width());
+    const int y1 = std::max(a_Y, std::max(a_Y1, 0));
+    const int y2 = std::min(a_Y + m_Height, std::min(a_Y2, a_Target->get_height()));
+    if ((x2 <= x1) || (y2 <= y1)) return;
+
+    SpanRows rows;
+    rows.src = m_Surface->get_buffer() + a_Frame * m_Width + (y1 - a_Y) * m_Pitch;
+    rows.dest = a_Target->get_buffer() + y1 * a_Target->get_pitch();
+    rows.row_spans = &m_RowSpans[a_Frame * m_Height + (y1 - a_Y)];
+    rows.spans = m_Spans.data();
+    rows.rows = y2 - y1;
+    rows.x = a_X;
+    rows.x1 = x1;
+    rows.x2 = x2;
+    rows.src_pitch = m_Pitch;
+    rows.dest_pitch = a_Target->get_pitch();
+    draw_span_rows(rows, (m_Flags & FLARE) != 0);
+}
+
 void Sprite::draw_scaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_Target)
 {
     if ((a_Width == 0) || (a_Height == 0)) return;
@@ -483,25 +613,32 @@ void Sprite::draw_scaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a
     }
 }
 
-void Sprite::initialize_start_data()
+//Splits every row of every frame into runs of pixels that aren't colour keyed (black, alpha is ignored)
+void Sprite::initialize_span_data()
 {
+    m_Spans.clear();
+    m_RowSpans.resize(m_NumFrames * m_Height + 1);
     for (unsigned int f = 0; f < m_NumFrames; ++f)
     {
-        m_Start[f] = new unsigned int[m_Height];
         for (int y = 0; y < m_Height; ++y)
         {
-            m_Start[f][y] = m_Width;
-            Pixel* addr = get_buffer() + f * m_Width + y * m_Pitch;
-            for (int x = 0; x < m_Width; ++x)
+            m_RowSpans[f * m_Height + y] = (unsigned int)m_Spans.size();
+            const Pixel* addr = get_buffer() + f * m_Width + y * m_Pitch;
+            for (int x = 0; x < m_Width;)
             {
-                if (addr[x])
+                if (!(addr[x] & 0xffffff))
                 {
-                    m_Start[f][y] = x;
-                    break;
+                    x++;
+                    continue;
                 }
+
+                const int start = x;
+                while (x < m_Width && (addr[x] & 0xffffff)) x++;
+                m_Spans.push_back(Span{ (unsigned short)start, (unsigned short)x });
             }
         }
     }
+    m_RowSpans[m_NumFrames * m_Height] = (unsigned int)m_Spans.size();
 }
 
 Font::Font(const char* a_File, const char* a_Chars)
@@ -78,6 +78,8 @@ class Surface
     void scale_color(unsigned int a_Scale);
     void box(int x1, int y1, int x2, int y2, Pixel color);
     void bar(int x1, int y1, int x2, int y2, Pixel color);
+    //Fills row y from x1 up to split with left and from split up to x2 with right, split and x2 are exclusive
+    void fill_row(int y, int x1, int split, int x2, Pixel left, Pixel right);
     void resize(Surface* a_Orig);
 
   private:
@@ -115,6 +117,8 @@ class Sprite
     ~Sprite();
     // Methods
     void draw(Surface* a_Target, int a_X, int a_Y);
+    //Draws the frame to rows a_Y1 up to a_Y2 of the target only, the current frame is left alone so threads can share the sprite
+    void draw_rows(Surface* a_Target, unsigned int a_Frame, int a_X, int a_Y, int a_Y1, int a_Y2) const;
     void draw_scaled(int a_X, int a_Y, int a_Width, int a_Height, Surface* a_Target);
     void set_flags(unsigned int a_Flags) { m_Flags = a_Flags; }
     void set_frame(unsigned int a_Index) { m_CurrentFrame = a_Index; }
@@ -124,15 +128,24 @@ class Sprite
     Pixel* get_buffer() { return m_Surface->get_buffer(); }
     unsigned int frames() { return m_NumFrames; }
     Surface* get_surface() { return m_Surface; }
-    void initialize_start_data();
+    void initialize_span_data();
+
+    //Run of opaque pixels in a row of a frame, end is exclusive
+    struct Span
+    {
+        unsigned short start, end;
+    };
 
   private:
+
     // Attributes
     int m_Width, m_Height, m_Pitch;
     unsigned int m_NumFrames;
     unsigned int m_CurrentFrame;
     unsigned int m_Flags;
-    unsigned int** m_Start;
+    //Opaque spans of all rows of all frames, the spans of row y of frame f are m_Spans[m_RowSpans[f * m_Height + y]] up to m_Spans[m_RowSpans[f * m_Height + y + 1]]
+    std::vector<Span> m_Spans;
+    std::vector<unsigned int> m_RowSpans;
     Surface* m_Surface;
 };
 
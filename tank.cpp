@@ -4,7 +4,55 @@
 
 namespace Tmpl8
 {
-Tank::Tank(
+//Allocates an uninitialized 64 byte aligned array, the size is rounded up to whole cache lines as aligned_alloc requires
+template <typename T>
+static T* allocate_aligned(size_t count)
+{
+    const size_t bytes = ((count * sizeof(T) + 63) / 64) * 64;
+    return (T*)MALLOC64(std::max(bytes, (size_t)64));
+}
+
+template <typename T>
+static void grow_aligned(T*& array, size_t count, size_t new_capacity)
+{
+    T* grown = allocate_aligned<T>(new_capacity);
+    if (array)
+    {
+        memcpy(grown, array, count * sizeof(T));
+        FREE64(array);
+    }
+    array = grown;
+}
+
+TankPool::~TankPool()
+{
+    if (capacity > 0)
+    {
+        FREE64(positions);
+        FREE64(forces);
+        FREE64(collision_radii);
+        FREE64(healths);
+        FREE64(teams);
+        FREE64(actives);
+    }
+}
+
+void TankPool::reserve(size_t new_capacity)
+{
+    if (new_capacity <= capacity) return;
+
+    grow_aligned(positions, count, new_capacity);
+    grow_aligned(forces, count, new_capacity);
+    grow_aligned(collision_radii, count, new_capacity);
+    grow_aligned(healths, count, new_capacity);
+    grow_aligned(teams, count, new_capacity);
+    grow_aligned(actives, count, new_capacity);
+    details.reserve(new_capacity);
+
+    capacity = new_capacity;
+}
+
+Tank TankPool::add(
     float pos_x,
     float pos_y,
     allignments allignment,
@@ -15,90 +63,108 @@ Tank::Tank(
     float collision_radius,
     int health,
     float max_speed)
-    : position(pos_x, pos_y),
-      allignment(allignment),
-      target(tar_x, tar_y),
-      health(health),
-      collision_radius(collision_radius),
-      max_speed(max_speed),
-      force(0, 0),
-      reload_time(1),
-      reloaded(false),
-      speed(0),
-      active(true),
-      current_frame(0),
-      tank_sprite(tank_sprite),
-      smoke_sprite(smoke_sprite)
-{
-}
-
-Tank::~Tank()
 {
+    if (count == capacity) reserve(std::max((size_t)16, capacity * 2));
+
+    positions[count] = vec2(pos_x, pos_y);
+    forces[count] = vec2(0, 0);
+    collision_radii[count] = collision_radius;
+    healths[count] = health;
+    teams[count] = allignment;
+    actives[count] = true;
+
+    Details tank_details;
+    tank_details.speed = vec2(0);
+    tank_details.target = vec2(tar_x, tar_y);
+    tank_details.route_id = Terrain::no_route;
+    tank_details.route_cursor = 0;
+    tank_details.max_speed = max_speed;
+    tank_details.reload_time = 1;
+    tank_details.reloaded = false;
+    tank_details.current_frame = 0;
+    tank_details.tank_sprite = tank_sprite;
+    tank_details.smoke_sprite = smoke_sprite;
+    details.push_back(std::move(tank_details));
+
+    return Tank(this, (int)count++);
 }
 
 void Tank::tick(Terrain& terrain)
 {
+    vec2& position = pool->positions[index];
+    vec2& force = pool->forces[index];
+    TankPool::Details& tank = pool->details[index];
+
     vec2 direction = vec2(0, 0);
 
-    if (target != position)
+    if (tank.target != position)
     {
-        direction = (target - position).normalized();
+        direction = (tank.target - position).normalized();
     }
 
-    //Update using accumulated force
-    speed = direction + force;
-    position += speed * max_speed * 0.5f;
+    //Update using accumulated force, slowed down by the terrain under the tank
+    //Impassable tiles only get entered by being pushed, move at full speed there so the tank can get off again
+    float speed_modifier = terrain.get_speed_modifier(position);
+    if (speed_modifier <= 0.f) speed_modifier = 1.f;
+
+    tank.speed = direction + force;
+    position += tank.speed * tank.max_speed * 0.5f * speed_modifier;
 
     //Update reload time
-    if (--reload_time <= 0.0f)
+    if (--tank.reload_time <= 0.0f)
     {
-        reloaded = true;
+        tank.reloaded = true;
     }
 
     force = vec2(0.f, 0.f);
 
-    if (++current_frame > 8) current_frame = 0;
+    if (++tank.current_frame > 8) tank.current_frame = 0;
 
     //Target reached?
-    if (current_route.size() > 0)
+    if (tank.route_id != Terrain::no_route)
     {
-        if (std::abs(position.x - target.x) < 8.f && std::abs(position.y - target.y) < 8.f)
+        const RouteView route = terrain.get_cached_route(tank.route_id);
+        if (tank.route_cursor < route.size() && std::abs(position.x - tank.target.x) < 8.f && std::abs(position.y - tank.target.y) < 8.f)
         {
-            target = current_route.at(0);
-            current_route.erase(current_route.begin());
+            tank.target = route[tank.route_cursor++];
         }
     }
 }
 
-void Tank::set_route(const std::vector<vec2>& route)
+void Tank::set_route(const RouteView& route)
 {
+    TankPool::Details& tank = pool->details[index];
+
     if (route.size() > 0)
     {
-        current_route = route;
-        target = current_route.at(0);
-        current_route.erase(current_route.begin());
+        //The route is shared with every tank that goes the same way, so only remember where we are on it
+        tank.route_id = route.get_id();
+        tank.route_cursor = 1;
+        tank.target = route[0];
     }
     else
     {
-        target = position;
+        tank.route_id = Terrain::no_route;
+        tank.target = pool->positions[index];
     }
 }
 
 //Start reloading timer
 void Tank::reload_rocket()
 {
-    reloaded = false;
-    reload_time = 200.0f;
+    pool->details[index].reloaded = false;
+    pool->details[index].reload_time = 200.0f;
 }
 
 void Tank::deactivate()
 {
-    active = false;
+    pool->actives[index] = false;
 }
 
 //Remove health
 bool Tank::hit(int hit_value)
 {
+    int& health = pool->healths[index];
     health -= hit_value;
 
     if (health <= 0)
@@ -111,22 +177,21 @@ bool Tank::hit(int hit_value)
 }
 
 //Draw the sprite with the facing based on this tanks movement direction
-void Tank::draw(Surface* screen)
+void Tank::draw(RenderQueue& render_queue) const
 {
-    vec2 direction = (target - position).normalized();
-    tank_sprite->set_frame(((abs(direction.x) > abs(direction.y)) ? ((direction.x < 0) ? 3 : 0) : ((direction.y < 0) ? 9 : 6)) + (current_frame / 3));
-    tank_sprite->draw(screen, (int)position.x - 7 + HEALTHBAR_OFFSET, (int)position.y - 9);
-}
+    const vec2 position = pool->positions[index];
+    const TankPool::Details& tank = pool->details[index];
 
-int Tank::compare_health(const Tank& other) const
-{
-    return ((health == other.health) ? 0 : ((health > other.health) ? 1 : -1));
+    vec2 direction = (tank.target - position).normalized();
+    const unsigned int frame = ((abs(direction.x) > abs(direction.y)) ? ((direction.x < 0) ? 3 : 0) : ((direction.y < 0) ? 9 : 6)) + (tank.current_frame / 3);
+    render_queue.add(tank.tank_sprite, frame, (int)position.x - 7 + HEALTHBAR_OFFSET, (int)position.y - 9);
 }
 
-//Add some force in a given direction
-void Tank::push(vec2 direction, float magnitude)
+int Tank::compare_health(const Tank& other) const
 {
-    force += direction * magnitude;
+    const int health = get_health();
+    const int other_health = other.get_health();
+    return ((health == other_health) ? 0 : ((health > other_health) ? 1 : -1));
 }
 
-} // namespace Tmpl8
\ No newline at end of file
+} // namespace Tmpl8
@@ -3,6 +3,8 @@
 namespace Tmpl8
 {
     class Terrain; //forward declare
+    class TankPool;
+    class RouteView;
 
 enum allignments
 {
@@ -10,54 +12,105 @@ enum allignments
     RED
 };
 
+//Lightweight handle to a tank stored in a TankPool
 class Tank
 {
   public:
-    Tank(float pos_x, float pos_y, allignments allignment, Sprite* tank_sprite, Sprite* smoke_sprite, float tar_x, float tar_y, float collision_radius, int health, float max_speed);
-
-    ~Tank();
+    Tank() = default;
+    Tank(TankPool* pool, int index) : pool(pool), index(index) {}
 
     void tick(Terrain& terrain);
 
-    vec2 get_position() const { return position; };
-    float get_collision_radius() const { return collision_radius; };
-    bool rocket_reloaded() const { return reloaded; };
+    vec2 get_position() const;
+    vec2 get_target() const;
+    float get_collision_radius() const;
+    int get_health() const;
+    allignments get_allignment() const;
+    bool is_active() const;
+    bool rocket_reloaded() const;
+    int get_index() const { return index; }
 
-    void set_route(const std::vector<vec2>& route);
+    void set_route(const RouteView& route);
     void reload_rocket();
 
     void deactivate();
     bool hit(int hit_value);
 
-    void draw(Surface* screen);
+    void draw(RenderQueue& render_queue) const;
 
     int compare_health(const Tank& other) const;
 
     void push(vec2 direction, float magnitude);
 
-    vec2 position;
-    vec2 speed;
-    vec2 target;
+  private:
+    TankPool* pool = nullptr;
+    int index = 0;
+};
+
+//Struct-of-arrays storage for all tanks
+//The fields every pass touches live in separate 64 byte aligned arrays, so a pass only streams what it reads
+class TankPool
+{
+  public:
+    TankPool() = default;
+    ~TankPool();
+
+    TankPool(const TankPool&) = delete;
+    TankPool& operator=(const TankPool&) = delete;
 
-    vector<vec2> current_route;
+    void reserve(size_t new_capacity);
 
-    int health;
+    Tank add(float pos_x, float pos_y, allignments allignment, Sprite* tank_sprite, Sprite* smoke_sprite, float tar_x, float tar_y, float collision_radius, int health, float max_speed);
 
-    float collision_radius;
-    vec2 force;
+    size_t size() const { return count; }
+    Tank operator[](size_t index) { return Tank(this, (int)index); }
 
-    float max_speed;
-    float reload_time;
+    //Hot data, indexed by tank
+    vec2* positions = nullptr;
+    vec2* forces = nullptr;
+    float* collision_radii = nullptr;
+    int* healths = nullptr;
+    allignments* teams = nullptr;
+    bool* actives = nullptr;
 
-    bool reloaded;
-    bool active;
+    //Cold data, only used by the tank itself
+    struct Details
+    {
+        vec2 speed;
+        vec2 target;
 
-    allignments allignment;
+        //Route in the route cache of the terrain and the index of the next waypoint on it
+        uint32_t route_id;
+        uint32_t route_cursor;
 
-    int current_frame;
-    Sprite* tank_sprite;
-    Sprite* smoke_sprite;
+        float max_speed;
+        float reload_time;
 
+        bool reloaded;
+
+        int current_frame;
+        Sprite* tank_sprite;
+        Sprite* smoke_sprite;
+    };
+    vector<Details> details;
+
+  private:
+    size_t count = 0;
+    size_t capacity = 0;
 };
 
-} // namespace Tmpl8
\ No newline at end of file
+inline vec2 Tank::get_position() const { return pool->positions[index]; }
+inline vec2 Tank::get_target() const { return pool->details[index].target; }
+inline float Tank::get_collision_radius() const { return pool->collision_radii[index]; }
+inline int Tank::get_health() const { return pool->healths[index]; }
+inline allignments Tank::get_allignment() const { return pool->teams[index]; }
+inline bool Tank::is_active() const { return pool->actives[index]; }
+inline bool Tank::rocket_reloaded() const { return pool->details[index].reloaded; }
+
+//Add some force in a given direction
+inline void Tank::push(vec2 direction, float magnitude)
+{
+    pool->forces[index] += direction * magnitude;
+}
+
+} // namespace Tmpl8
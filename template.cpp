@@ -92,6 +92,119 @@ mat4 mat4::rotatez(const float a)
     return M;
 }
 
+//Twice the signed area of the triangle (o, a, b), negative if b lies on the left of the line from o to a
+static float orientation(const vec2& o, const vec2& a, const vec2& b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+void convex_hull(std::vector<vec2>& points, std::vector<vec2>& hull)
+{
+    hull.clear();
+
+    if (points.size() < 2)
+    {
+        hull = points;
+        return;
+    }
+
+    std::sort(points.begin(), points.end(), [](const vec2& a, const vec2& b) { return (a.x < b.x) || (a.x == b.x && a.y < b.y); });
+
+    hull.resize(points.size() * 2);
+    size_t k = 0;
+
+    //Lower hull
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        while (k >= 2 && orientation(hull[k - 2], hull[k - 1], points[i]) <= 0) k--;
+        hull[k++] = points[i];
+    }
+
+    //Upper hull, skipping the last point because it ends the lower hull
+    for (size_t i = points.size() - 1, t = k + 1; i > 0; i--)
+    {
+        while (k >= t && orientation(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) k--;
+        hull[k++] = points[i - 1];
+    }
+
+    //The first point was added again to close the upper hull
+    hull.resize(k - 1);
+}
+
+//Intersection of the lines through a1 and a2 with directions d1 and d2 (which may not be parallel)
+static vec2 line_intersection(const vec2& a1, const vec2& d1, const vec2& a2, const vec2& d2)
+{
+    const float t = (d2.x * (a2.y - a1.y) - d2.y * (a2.x - a1.x)) / (d2.x * d1.y - d2.y * d1.x);
+    return a1 + d1 * t;
+}
+
+void inset_convex_polygon(const std::vector<vec2>& polygon, float margin, std::vector<vec2>& inset)
+{
+    inset.clear();
+
+    const size_t n = polygon.size();
+    if (n < 3) return;
+
+    //Edge i is the half plane left of (line_start[i], line_start[i] + line_dir[i]), moved inwards by margin
+    std::vector<vec2> line_start(n);
+    std::vector<vec2> line_dir(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        line_dir[i] = polygon[(i + 1) % n] - polygon[i];
+        const vec2 inward = vec2(-line_dir[i].y, line_dir[i].x).normalized();
+        line_start[i] = polygon[i] + inward * margin;
+    }
+
+    auto outside = [&](size_t line, const vec2& point) { return orientation(line_start[line], line_start[line] + line_dir[line], point) <= 0; };
+    auto corner = [&](size_t a, size_t b) { return line_intersection(line_start[a], line_dir[a], line_start[b], line_dir[b]); };
+
+    //The edges are already sorted by angle, so the half plane intersection needs a single pass with a deque
+    //Shifted edges which no longer contribute to the boundary fall off either end
+    std::vector<size_t> lines(n);
+    size_t front = 0, back = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        while (back - front >= 2 && outside(i, corner(lines[back - 2], lines[back - 1]))) back--;
+        while (back - front >= 2 && outside(i, corner(lines[front], lines[front + 1]))) front++;
+        lines[back++] = i;
+    }
+    while (back - front >= 3 && outside(lines[front], corner(lines[back - 2], lines[back - 1]))) back--;
+    while (back - front >= 3 && outside(lines[back - 1], corner(lines[front], lines[front + 1]))) front++;
+
+    if (back - front < 3) return;
+
+    for (size_t i = front; i < back; i++)
+    {
+        inset.push_back(corner(lines[i], lines[(i + 1 < back) ? i + 1 : front]));
+    }
+}
+
+bool point_in_convex_polygon(const std::vector<vec2>& polygon, const vec2& point)
+{
+    const size_t n = polygon.size();
+    if (n < 3) return false;
+
+    //Outside of the fan of wedges around polygon[0]
+    if (orientation(polygon[0], polygon[1], point) <= 0 || orientation(polygon[0], polygon[n - 1], point) >= 0) return false;
+
+    //Find the wedge (polygon[0], polygon[low], polygon[low + 1]) containing the point
+    size_t low = 1, high = n - 1;
+    while (high - low > 1)
+    {
+        const size_t mid = (low + high) / 2;
+        if (orientation(polygon[0], polygon[mid], point) > 0)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return orientation(polygon[low], polygon[low + 1], point) > 0;
+}
+
 void NotifyUser(const char* s)
 {
     std::cout << "ERROR: " << s << std::endl;
@@ -100,6 +213,9 @@ void NotifyUser(const char* s)
 }
 } // namespace Tmpl8
 
+// Everything below is the SDL/OpenGL window, HEADLESS builds provide their own main
+#ifndef HEADLESS
+
 using namespace Tmpl8;
 using namespace std;
 
@@ -319,3 +435,5 @@ int main(int argc, char** argv)
     SDL_Quit();
     return 1;
 }
+
+#endif
@@ -647,6 +647,19 @@ inline bool circle_segment_intersect(vec2 s1, vec2 s2, vec2 cp, float r)
     }
 }
 
+//Andrew's monotone chain convex hull, O(n log n)
+//Sorts points in place, hull is overwritten with the hull vertices counter-clockwise (in y-up coordinates)
+//(collinear points on hull edges are left out)
+void convex_hull(std::vector<vec2>& points, std::vector<vec2>& hull);
+
+//Shrinks a convex polygon (as returned by convex_hull) by margin, by intersecting the inward shifted edges in O(n)
+//Points strictly inside the result are more than margin away from every edge, the result is empty if nothing is left
+void inset_convex_polygon(const std::vector<vec2>& polygon, float margin, std::vector<vec2>& inset);
+
+//Binary search over the wedges around polygon[0] of a convex polygon (as returned by convex_hull), O(log n)
+//Points on the boundary are outside
+bool point_in_convex_polygon(const std::vector<vec2>& polygon, const vec2& point);
+
 #define BADFLOAT(x) ((*(uint*)&x & 0x7f000000) == 0x7f000000)
 
 }; // namespace Tmpl8
@@ -1,10 +1,9 @@
 #include "precomp.h"
 #include "terrain.h"
 
-namespace fs = std::filesystem;
 namespace Tmpl8
 {
-    Terrain::Terrain()
+    Terrain::Terrain(const std::string& terrain_file_path)
     {
         //Load in terrain sprites
         grass_img = std::make_unique<Surface>("assets/tile_grass.png");
@@ -21,9 +20,9 @@ namespace Tmpl8
         tile_mountains = std::make_unique<Sprite>(mountains_img.get(), 1);
 
 
-        //Load terrain layout file and fill grid based on tiletypes
-        fs::path terrain_file_path{ "assets/terrain.txt" };
+        //Load terrain layout file, the first line holds the number of rows and the longest row sets the width
         std::ifstream terrain_file(terrain_file_path);
+        std::vector<std::string> rows;
 
         if (terrain_file.is_open())
         {
@@ -32,39 +31,17 @@ namespace Tmpl8
             std::getline(terrain_file, terrain_line);
             std::istringstream lineStream(terrain_line);
 
-            int rows;
+            int num_rows = 0;
 
-            lineStream >> rows;
+            lineStream >> num_rows;
 
-            for (size_t row = 0; row < rows; row++)
+            for (int row = 0; row < num_rows && std::getline(terrain_file, terrain_line); row++)
             {
-                std::getline(terrain_file, terrain_line);
-
-                for (size_t collumn = 0; collumn < terrain_line.size(); collumn++)
-                {
-                    switch (std::toupper(terrain_line.at(collumn)))
-                    {
-                    case 'G':
-                        tiles.at(row).at(collumn).tile_type = TileType::GRASS;
-                        break;
-                    case 'F':
-                        tiles.at(row).at(collumn).tile_type = TileType::FORREST;
-                        break;
-                    case 'R':
-                        tiles.at(row).at(collumn).tile_type = TileType::ROCKS;
-                        break;
-                    case 'M':
-                        tiles.at(row).at(collumn).tile_type = TileType::MOUNTAINS;
-                        break;
-                    case 'W':
-                        tiles.at(row).at(collumn).tile_type = TileType::WATER;
-                        break;
-                    default:
-                        tiles.at(row).at(collumn).tile_type = TileType::GRASS;
-                        break;
-                    }
-                }
+                if (!terrain_line.empty() && terrain_line.back() == '\r') terrain_line.pop_back();
+                rows.push_back(terrain_line);
+                width = std::max(width, terrain_line.size());
             }
+            height = rows.size();
         }
         else
         {
@@ -72,20 +49,65 @@ namespace Tmpl8
             std::cout << "Path was: " << terrain_file_path << std::endl;
         }
 
+        //Fall back to a screen filling grass field
+        if (width == 0 || height == 0)
+        {
+            width = (SCRWIDTH - (HEALTHBAR_OFFSET * 2)) / sprite_size;
+            height = SCRHEIGHT / sprite_size;
+            rows.clear();
+        }
+
+        //Fill grid based on tiletypes, missing tiles are grass
+        tiles.resize(width * height);
+        for (size_t row = 0; row < rows.size(); row++)
+        {
+            for (size_t collumn = 0; collumn < rows[row].size(); collumn++)
+            {
+                TerrainTile& tile = tiles[row * width + collumn];
+                switch (std::toupper(rows[row].at(collumn)))
+                {
+                case 'G':
+                    tile.tile_type = TileType::GRASS;
+                    break;
+                case 'F':
+                    tile.tile_type = TileType::FORREST;
+                    break;
+                case 'R':
+                    tile.tile_type = TileType::ROCKS;
+                    break;
+                case 'M':
+                    tile.tile_type = TileType::MOUNTAINS;
+                    break;
+                case 'W':
+                    tile.tile_type = TileType::WATER;
+                    break;
+                default:
+                    tile.tile_type = TileType::GRASS;
+                    break;
+                }
+            }
+        }
+
         //Instantiate tiles for path planning
-        for (size_t y = 0; y < tiles.size(); y++)
+        tile_costs.resize(width * height);
+        for (size_t y = 0; y < height; y++)
         {
-            for (size_t x = 0; x < tiles.at(y).size(); x++)
+            for (size_t x = 0; x < width; x++)
             {
-                tiles.at(y).at(x).position_x = x;
-                tiles.at(y).at(x).position_y = y;
+                tiles[y * width + x].position_x = x;
+                tiles[y * width + x].position_y = y;
 
-                if (is_accessible(y, x + 1)) { tiles.at(y).at(x).exits.push_back(&tiles.at(y).at(x + 1)); }
-                if (is_accessible(y, x - 1)) { tiles.at(y).at(x).exits.push_back(&tiles.at(y).at(x - 1)); }
-                if (is_accessible(y + 1, x)) { tiles.at(y).at(x).exits.push_back(&tiles.at(y + 1).at(x)); }
-                if (is_accessible(y - 1, x)) { tiles.at(y).at(x).exits.push_back(&tiles.at(y - 1).at(x)); }
+                update_tile_cost(x, y);
             }
         }
+
+        hierarchy.reset(width, height);
+
+        //Compose the part of the map that fits on the screen once, draw() only copies it
+        const size_t visible_width = std::min(width, (size_t)(SCRWIDTH - (HEALTHBAR_OFFSET * 2)) / sprite_size);
+        const size_t visible_height = std::min(height, (size_t)SCRHEIGHT / sprite_size);
+        background = std::make_unique<Surface>((int)(visible_width * sprite_size), (int)(visible_height * sprite_size));
+        draw_tiles(TileBounds{ 0, 0, visible_width, visible_height });
     }
 
     void Terrain::update()
@@ -93,116 +115,383 @@ namespace Tmpl8
         //Pretend there is animation code here.. next year :)
     }
 
-    void Terrain::draw(Surface* target) const
+    //Starts the frame: copies the background to the screen row by row, after bringing the parts that changed up to date
+    //The health bar gutters and whatever the map doesn't cover are cleared in the same pass, so every pixel is written once
+    void Terrain::draw(Surface* target)
+    {
+        for (const TileBounds& area : dirty_rects)
+        {
+            draw_tiles(area);
+        }
+        dirty_rects.clear();
+
+        const int target_width = target->get_width();
+        const int target_height = target->get_height();
+        const int copy_width = std::max(0, std::min(background->get_width(), target_width - HEALTHBAR_OFFSET));
+        const int copy_height = std::min(background->get_height(), target_height);
+
+        const Pixel* src = background->get_buffer();
+        Pixel* dst = target->get_buffer();
+        for (int y = 0; y < target_height; y++)
+        {
+            if (y < copy_height)
+            {
+                const int gutter = std::min(HEALTHBAR_OFFSET, target_width);
+                std::fill(dst, dst + gutter, 0);
+                memcpy(dst + gutter, src, copy_width * sizeof(Pixel));
+                std::fill(dst + gutter + copy_width, dst + target_width, 0);
+                src += background->get_pitch();
+            }
+            else
+            {
+                std::fill(dst, dst + target_width, 0);
+            }
+            dst += target->get_pitch();
+        }
+
+        //Clearing the screen first would have written the copied pixels twice
+        const float bytes_per_mb = 1024.f * 1024.f;
+        PROFILE_COUNT("draw/background MB written", (float)target_width * target_height * sizeof(Pixel) / bytes_per_mb);
+        PROFILE_COUNT("draw/background MB saved", (float)copy_width * copy_height * sizeof(Pixel) / bytes_per_mb);
+    }
+
+    void Terrain::mark_dirty(const TileBounds& area)
     {
+        dirty_rects.push_back(area);
+    }
+
+    //Draws the tiles in the area into the background, clipped to the part of the map that fits on the screen
+    void Terrain::draw_tiles(const TileBounds& area)
+    {
+        const size_t visible_width = background->get_width() / sprite_size;
+        const size_t visible_height = background->get_height() / sprite_size;
+        const size_t max_x = std::min(area.max_x, visible_width);
+        const size_t max_y = std::min(area.max_y, visible_height);
+        if (area.min_x >= max_x) return;
 
-        for (size_t y = 0; y < tiles.size(); y++)
+        for (size_t y = area.min_y; y < max_y; y++)
         {
-            for (size_t x = 0; x < tiles.at(y).size(); x++)
+            //Sprites skip transparent pixels, so clear what was there before
+            Pixel* row = background->get_buffer() + y * sprite_size * background->get_pitch();
+            for (int line = 0; line < sprite_size; line++)
+            {
+                std::fill(row + area.min_x * sprite_size, row + max_x * sprite_size, 0);
+                row += background->get_pitch();
+            }
+
+            for (size_t x = area.min_x; x < max_x; x++)
             {
-                int posX = (x * sprite_size) + HEALTHBAR_OFFSET;
+                int posX = x * sprite_size;
                 int posY = y * sprite_size;
 
-                switch (tiles.at(y).at(x).tile_type)
+                switch (tiles[y * width + x].tile_type)
                 {
                 case TileType::GRASS:
-                    tile_grass->draw(target, posX, posY);
+                    tile_grass->draw(background.get(), posX, posY);
                     break;
                 case TileType::FORREST:
-                    tile_forest->draw(target, posX, posY);
+                    tile_forest->draw(background.get(), posX, posY);
                     break;
                 case TileType::ROCKS:
-                    tile_rocks->draw(target, posX, posY);
+                    tile_rocks->draw(background.get(), posX, posY);
                     break;
                 case TileType::MOUNTAINS:
-                    tile_mountains->draw(target, posX, posY);
+                    tile_mountains->draw(background.get(), posX, posY);
                     break;
                 case TileType::WATER:
-                    tile_water->draw(target, posX, posY);
+                    tile_water->draw(background.get(), posX, posY);
                     break;
                 default:
-                    tile_grass->draw(target, posX, posY);
+                    tile_grass->draw(background.get(), posX, posY);
                     break;
                 }
             }
         }
     }
 
-    //Use Breadth-first search to find shortest route to the destination
-    vector<vec2> Terrain::get_route(const Tank& tank, const vec2& target)
+    //Routes are stored as tile indices, one after the other in route_tiles, and never removed again
+    RouteView Terrain::get_route(const Tank& tank, const vec2& target)
+    {
+        const size_t start = to_tile_y(tank.get_position().y) * width + to_tile_x(tank.get_position().x);
+        const size_t destination = to_tile_y(target.y) * width + to_tile_x(target.x);
+        const uint64_t key = ((uint64_t)start << 32) | (uint64_t)destination;
+
+        auto found = route_cache.find(key);
+        if (found != route_cache.end())
+        {
+            route_cache_hits++;
+            return get_cached_route(found->second);
+        }
+
+        route_cache_misses++;
+        calculate_route(start % width, start / width, destination % width, destination / width, route_scratch);
+
+        const uint32_t begin = (uint32_t)route_tiles.size();
+        for (const vec2& waypoint : route_scratch)
+        {
+            route_tiles.push_back((uint32_t)(to_tile_y(waypoint.y) * width + to_tile_x(waypoint.x)));
+        }
+
+        const uint32_t route_id = (uint32_t)routes.size();
+        routes.push_back(std::make_pair(begin, (uint32_t)route_scratch.size()));
+        route_cache.emplace(key, route_id);
+
+        return get_cached_route(route_id);
+    }
+
+    RouteView Terrain::get_cached_route(uint32_t route_id) const
+    {
+        return RouteView(route_tiles, route_id, routes[route_id].first, routes[route_id].second, width);
+    }
+
+    //Follow the flow field of the destination tile to get the cheapest route to it
+    void Terrain::calculate_route(size_t pos_x, size_t pos_y, size_t target_x, size_t target_y, vector<vec2>& route)
+    {
+        route.clear();
+
+        if (width * height > max_flow_field_tiles)
+        {
+            hierarchy.find_route(*this, pos_x, pos_y, target_x, target_y, route_search, route);
+            return;
+        }
+
+        //A flow field only pays off when routes share the destination, so the first route to a tile is a single search
+        if (flow_fields.count(target_y * width + target_x) == 0 && routed_destinations.insert(target_y * width + target_x).second)
+        {
+            find_route(pos_x, pos_y, target_x, target_y, route_search, route);
+            return;
+        }
+
+        const FlowField& field = get_flow_field(target_x, target_y);
+        if (field.cost[pos_y * width + pos_x] == UINT32_MAX)
+        {
+            return;
+        }
+
+        //Every step costs at least min_tile_cost, which bounds the number of steps
+        route.reserve(field.cost[pos_y * width + pos_x] / min_tile_cost + 1);
+        route.push_back(vec2((float)pos_x * sprite_size, (float)pos_y * sprite_size));
+
+        //Every tile points to its neighbour on a cheapest route, so just step until we arrive
+        while (pos_x != target_x || pos_y != target_y)
+        {
+            const uint8_t direction = field.direction[pos_y * width + pos_x];
+            pos_x += directions[direction][0];
+            pos_y += directions[direction][1];
+            route.push_back(vec2((float)pos_x * sprite_size, (float)pos_y * sprite_size));
+        }
+    }
+
+    const FlowField& Terrain::get_flow_field(size_t target_x, size_t target_y)
+    {
+        auto found = flow_fields.find(target_y * width + target_x);
+        if (found != flow_fields.end())
+        {
+            return found->second;
+        }
+
+        FlowField& field = flow_fields[target_y * width + target_x];
+        build_flow_field(target_x, target_y, route_search, field);
+        return field;
+    }
+
+    bool Terrain::find_route(size_t start_x, size_t start_y, size_t target_x, size_t target_y, RouteSearch& search, vector<vec2>& route) const
     {
-        //Find start and target tile
-        const size_t pos_x = tank.position.x / sprite_size;
-        const size_t pos_y = tank.position.y / sprite_size;
+        return find_route(start_x, start_y, target_x, target_y, TileBounds{ 0, 0, width, height }, search, route);
+    }
+
+    //A* search with the manhattan distance times the cheapest tile cost as heuristic, which never overestimates
+    bool Terrain::find_route(size_t start_x, size_t start_y, size_t target_x, size_t target_y, const TileBounds& bounds, RouteSearch& search, vector<vec2>& route) const
+    {
+        route.clear();
+        search.begin(width * height);
 
-        const size_t target_x = target.x / sprite_size;
-        const size_t target_y = target.y / sprite_size;
+        if (!is_accessible((int)target_y, (int)target_x))
+        {
+            return false;
+        }
 
-        //Init queue with start tile
-        std::queue<vector<TerrainTile*>> queue;
-        queue.emplace();
-        queue.back().push_back(&tiles.at(pos_y).at(pos_x));
+        const uint32_t start = (uint32_t)(start_y * width + start_x);
+        const uint32_t target = (uint32_t)(target_y * width + target_x);
 
-        std::vector<TerrainTile*> visited;
+        auto heuristic = [&](int x, int y) {
+            return (uint32_t)(std::abs(x - (int)target_x) + std::abs(y - (int)target_y)) * min_tile_cost;
+        };
+
+        //Binary min-heap on (estimated total cost, tile), improved tiles are pushed again and stale entries skipped
+        search.open.clear();
+        search.open.push_back({ heuristic((int)start_x, (int)start_y), start });
+        search.visited[start] = search.generation;
+        search.cost[start] = 0;
 
         bool route_found = false;
-        vector<TerrainTile*> current_route;
-        while (!queue.empty() && !route_found)
+        while (!search.open.empty())
         {
-            current_route = queue.front();
-            queue.pop();
-            TerrainTile* current_tile = current_route.back();
+            std::pop_heap(search.open.begin(), search.open.end(), std::greater<>());
+            const uint32_t current = search.open.back().second;
+            search.open.pop_back();
+
+            if (search.closed[current] == search.generation) continue;
+            search.closed[current] = search.generation;
 
-            //Check all exits, if target then done, else if unvisited push a new partial route
-            for (TerrainTile * exit : current_tile->exits)
+            if (current == target)
             {
-                if (exit->position_x == target_x && exit->position_y == target_y)
+                route_found = true;
+                break;
+            }
+
+            const int x = (int)(current % width);
+            const int y = (int)(current / width);
+
+            //Check all exits and keep the cheapest way to get to each of them
+            for (uint8_t d = 0; d < 4; d++)
+            {
+                const int neighbour_x = x + directions[d][0];
+                const int neighbour_y = y + directions[d][1];
+                if (neighbour_x < (int)bounds.min_x || neighbour_x >= (int)bounds.max_x || neighbour_y < (int)bounds.min_y || neighbour_y >= (int)bounds.max_y)
                 {
-                    current_route.push_back(exit);
-                    route_found = true;
-                    break;
+                    continue;
+                }
+
+                const uint32_t neighbour = (uint32_t)(neighbour_y * width + neighbour_x);
+                if (tile_costs[neighbour] == 0)
+                {
+                    continue;
                 }
-                else if (!exit->visited)
+
+                const uint32_t cost = search.cost[current] + tile_costs[neighbour];
+                if (search.visited[neighbour] != search.generation || cost < search.cost[neighbour])
                 {
-                    exit->visited = true;
-                    visited.push_back(exit);
-                    queue.push(current_route);
-                    queue.back().push_back(exit);
+                    search.visited[neighbour] = search.generation;
+                    search.cost[neighbour] = cost;
+                    search.parent[neighbour] = current;
+
+                    search.open.push_back({ cost + heuristic(neighbour_x, neighbour_y), neighbour });
+                    std::push_heap(search.open.begin(), search.open.end(), std::greater<>());
                 }
             }
         }
 
-        //Reset tiles
-        for (TerrainTile * tile : visited)
+        if (!route_found)
         {
-            tile->visited = false;
+            return false;
         }
 
-        if (route_found)
+        //Walk the parents back to the start and flip the route around
+        for (uint32_t tile = target;; tile = search.parent[tile])
         {
-            //Convert route to vec2 to prevent dangling pointers
-            std::vector<vec2> route;
-            for (TerrainTile* tile : current_route)
-            {
-                route.push_back(vec2((float)tile->position_x * sprite_size, (float)tile->position_y * sprite_size));
-            }
+            route.push_back(vec2((float)(tile % width) * sprite_size, (float)(tile / width) * sprite_size));
+            if (tile == start) break;
+        }
+        std::reverse(route.begin(), route.end());
+
+        return true;
+    }
 
-            return route;
+    void RouteSearch::begin(size_t num_tiles)
+    {
+        if (visited.size() != num_tiles)
+        {
+            visited.assign(num_tiles, 0);
+            closed.assign(num_tiles, 0);
+            cost.resize(num_tiles);
+            parent.resize(num_tiles);
+            open.reserve(num_tiles);
+            generation = 0;
         }
-        else
+
+        //Start a new generation, only when the counter wraps around do the old marks have to go
+        if (++generation == 0)
+        {
+            std::fill(visited.begin(), visited.end(), 0);
+            std::fill(closed.begin(), closed.end(), 0);
+            generation = 1;
+        }
+    }
+
+    //Dijkstra outwards from the destination, every tile that is reached points back to the tile it was reached from
+    //Tile costs are small integers, so a bucket queue (Dial's algorithm) replaces the heap: the costs waiting in the queue
+    //always lie within max_tile_cost of the cheapest one, so max_tile_cost + 1 buckets used in a circle are enough
+    void Terrain::build_flow_field(size_t target_x, size_t target_y, RouteSearch& search, FlowField& field) const
+    {
+        field.cost.assign(width * height, UINT32_MAX);
+        field.direction.assign(width * height, FlowField::no_direction);
+
+        const uint32_t target = (uint32_t)(target_y * width + target_x);
+
+        //Inaccessible destinations can't be reached from anywhere
+        if (tile_costs[target] == 0)
         {
-            return  std::vector<vec2>();
+            return;
         }
 
+        //The cost field already holds the best known cost of each tile, so the buckets are the only other state
+        auto& buckets = search.buckets;
+        static_assert(std::tuple_size<decltype(RouteSearch::buckets)>::value == max_tile_cost + 1, "One bucket per possible cost difference is needed");
+        for (vector<uint32_t>& bucket : buckets)
+        {
+            bucket.clear();
+        }
+
+        buckets[0].push_back(target);
+        field.cost[target] = 0;
+        size_t queued = 1;
+
+        for (uint32_t current_cost = 0; queued > 0; current_cost++)
+        {
+            vector<uint32_t>& bucket = buckets[current_cost % buckets.size()];
+
+            //Tiles get pushed to later buckets only, so this bucket can't grow while we empty it
+            for (size_t i = 0; i < bucket.size(); i++)
+            {
+                const uint32_t current = bucket[i];
+
+                //Stale entry, the tile was reached more cheaply in the meantime
+                if (field.cost[current] != current_cost) continue;
+
+                //Routes only pass through accessible tiles, but may start on any tile
+                if (tile_costs[current] == 0) continue;
+
+                //Stepping from a neighbour onto this tile costs this tile's cost
+                const uint32_t cost = current_cost + tile_costs[current];
+
+                const int x = (int)(current % width);
+                const int y = (int)(current / width);
+                for (uint8_t d = 0; d < 4; d++)
+                {
+                    const int neighbour_x = x + directions[d][0];
+                    const int neighbour_y = y + directions[d][1];
+                    if (neighbour_x < 0 || neighbour_x >= (int)width || neighbour_y < 0 || neighbour_y >= (int)height)
+                    {
+                        continue;
+                    }
+
+                    const uint32_t neighbour = (uint32_t)(neighbour_y * width + neighbour_x);
+                    if (cost < field.cost[neighbour])
+                    {
+                        //The neighbour gets to the destination by stepping back to this tile, the opposite direction
+                        field.cost[neighbour] = cost;
+                        field.direction[neighbour] = d ^ 1;
+                        buckets[cost % buckets.size()].push_back(neighbour);
+                        queued++;
+                    }
+                }
+            }
+
+            queued -= bucket.size();
+            bucket.clear();
+        }
     }
 
-    //TODO: Function not used, convert BFS to dijkstra and take speed into account next year :)
+    //Speed multiplier for tanks on the tile at the given position, positions outside the map use the closest tile
     float Terrain::get_speed_modifier(const vec2& position) const
     {
-        const size_t pos_x = position.x / sprite_size;
-        const size_t pos_y = position.y / sprite_size;
+        return get_speed_modifier(tiles[to_tile_y(position.y) * width + to_tile_x(position.x)].tile_type);
+    }
 
-        switch (tiles.at(pos_y).at(pos_x).tile_type)
+    float Terrain::get_speed_modifier(TileType tile_type)
+    {
+        switch (tile_type)
         {
         case TileType::GRASS:
             return 1.0f;
@@ -225,13 +514,13 @@ namespace Tmpl8
         }
     }
 
-    bool Terrain::is_accessible(int y, int x)
+    bool Terrain::is_accessible(int y, int x) const
     {
         //Bounds check
-        if ((x >= 0 && x < terrain_width) && (y >= 0 && y < terrain_height))
+        if ((x >= 0 && x < (int)width) && (y >= 0 && y < (int)height))
         {
             //Inaccessible terrain check
-            if (tiles.at(y).at(x).tile_type != TileType::MOUNTAINS && tiles.at(y).at(x).tile_type != TileType::WATER)
+            if (tiles[y * width + x].tile_type != TileType::MOUNTAINS && tiles[y * width + x].tile_type != TileType::WATER)
             {
                 return true;
             }
@@ -239,4 +528,36 @@ namespace Tmpl8
 
         return false;
     }
-}
\ No newline at end of file
+
+    void Terrain::set_tile_type(size_t x, size_t y, TileType tile_type)
+    {
+        if (tiles[y * width + x].tile_type == tile_type) return;
+
+        tiles[y * width + x].tile_type = tile_type;
+        update_tile_cost(x, y);
+
+        //Every flow field and route may differ now, the hierarchy only has to redo the clusters around the tile
+        flow_fields.clear();
+        routed_destinations.clear();
+        hierarchy.invalidate(x, y);
+        mark_dirty(TileBounds{ x, y, x + 1, y + 1 });
+
+        //Cached routes may be wrong now, but stay stored so views that were handed out remain valid
+        route_cache.clear();
+    }
+
+    void Terrain::update_tile_cost(size_t x, size_t y)
+    {
+        tile_costs[y * width + x] = is_accessible((int)y, (int)x) ? (uint8_t)((float)min_tile_cost / get_speed_modifier(tiles[y * width + x].tile_type) + 0.5f) : 0;
+    }
+
+    size_t Terrain::to_tile_x(float x) const
+    {
+        return (size_t)clamp((int)(x / sprite_size), 0, (int)width - 1);
+    }
+
+    size_t Terrain::to_tile_y(float y) const
+    {
+        return (size_t)clamp((int)(y / sprite_size), 0, (int)height - 1);
+    }
+}
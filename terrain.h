@@ -14,40 +14,136 @@ namespace Tmpl8
     class TerrainTile
     {
     public:
-        //TerrainTile *up, *down, *left, *right;
-        vector<TerrainTile*> exits;
-        bool visited = false;
-
         size_t position_x;
         size_t position_y;
 
-        TileType tile_type;
+        TileType tile_type = TileType::GRASS;
 
     private:
     };
 
+    //Route to a single destination tile from every tile, filled by one search outwards from the destination
+    struct FlowField
+    {
+        static constexpr uint8_t no_direction = 0xff;
+
+        vector<uint32_t> cost;     //Integration field, cost of the cheapest route to the destination
+        vector<uint8_t> direction; //Step towards the destination (index into Terrain::directions), no_direction if it can't be reached
+    };
+
+    //Rectangle of tiles a search may use, max is exclusive
+    struct TileBounds
+    {
+        size_t min_x;
+        size_t min_y;
+        size_t max_x;
+        size_t max_y;
+    };
+
+    //Scratch space for route searches, every thread that searches needs its own
+    //Tiles are marked visited with the generation of the search, so the buffers never have to be cleared between searches
+    struct RouteSearch
+    {
+        vector<uint32_t> visited; //Generation of the last search that reached the tile
+        vector<uint32_t> closed;  //Generation of the last search that expanded the tile
+        vector<uint32_t> cost;    //Cost from the start, valid when visited in this generation
+        vector<uint32_t> parent;  //Tile the search came from
+        vector<std::pair<uint32_t, uint32_t>> open; //Heap of (cost, tile)
+        std::array<vector<uint32_t>, 25> buckets;  //Bucket queue of the flow field search, max_tile_cost + 1 buckets
+        uint32_t generation = 0;
+
+        //Used by RouteHierarchy
+        vector<uint32_t> cluster_cost; //Costs within one cluster, by tile inside the cluster
+        vector<uint32_t> start_costs;  //Cost from the start to each node of its cluster
+        vector<uint32_t> goal_costs;   //Cost from each node of the goal cluster to the goal
+        vector<uint32_t> waypoints;    //Abstract route
+        vector<vec2> segment;          //Refined part of the route
+
+        //Sizes the tile buffers for the map and starts a new generation of visited marks
+        void begin(size_t num_tiles);
+    };
+
+    class RouteView;
+
     class Terrain
     {
     public:
 
-        Terrain();
+        Terrain(const std::string& terrain_file_path = "assets/terrain.txt");
 
         void update();
-        void draw(Surface* target) const;
 
-        //Use Breadth-first search to find shortest route to the destination
-        vector<vec2> get_route(const Tank& tank, const vec2& target);
+        //Writes the whole target, the map and the cleared health bar gutters, so the screen doesn't have to be cleared first
+        void draw(Surface* target);
+
+        //Redraws the area of the background before the next frame, for tiles that change how they look
+        void mark_dirty(const TileBounds& area);
+
+        //Cheapest route to the destination, cached by start and destination tile so tanks that share both share the route
+        RouteView get_route(const Tank& tank, const vec2& target);
+
+        //Route handed out by get_route earlier, routes are immutable and stay stored for as long as the terrain exists
+        RouteView get_cached_route(uint32_t route_id) const;
+
+        size_t get_route_cache_hits() const { return route_cache_hits; }
+        size_t get_route_cache_misses() const { return route_cache_misses; }
+
+        //A* search for the cheapest route between two tiles, doesn't allocate once search and route have grown
+        //Only touches search and route, so it can run on several threads at once
+        bool find_route(size_t start_x, size_t start_y, size_t target_x, size_t target_y, RouteSearch& search, vector<vec2>& route) const;
+
+        //Same, but only through tiles within bounds (start and target have to be inside)
+        bool find_route(size_t start_x, size_t start_y, size_t target_x, size_t target_y, const TileBounds& bounds, RouteSearch& search, vector<vec2>& route) const;
+
+        //Flow field towards the given tile, built on first use and shared by every route to that tile
+        const FlowField& get_flow_field(size_t target_x, size_t target_y);
+
+        //Changes a tile and drops everything that was derived from the old one
+        void set_tile_type(size_t x, size_t y, TileType tile_type);
 
         float get_speed_modifier(const vec2& position) const;
+        static float get_speed_modifier(TileType tile_type);
 
+        size_t get_width() const { return width; }
+        size_t get_height() const { return height; }
 
-    private:
+        //Cost of stepping onto the tile (y * width + x), 0 if it is inaccessible
+        uint32_t get_tile_cost(size_t tile) const { return tile_costs[tile]; }
 
-        bool is_accessible(int y, int x);
+        //Route cost of a grass tile, slower tiles cost proportionally more (forest 24, rocks 16)
+        static constexpr uint32_t min_tile_cost = 12;
+        static constexpr uint32_t max_tile_cost = 24;
 
         static constexpr int sprite_size = 16;
-        static constexpr size_t terrain_width = 80;
-        static constexpr size_t terrain_height = 45;
+
+        //Route id for no route at all
+        static constexpr uint32_t no_route = UINT32_MAX;
+
+        //Neighbour offsets: right, left, down, up
+        static constexpr int directions[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+    private:
+
+        bool is_accessible(int y, int x) const;
+        void update_tile_cost(size_t x, size_t y);
+
+        //Tile that contains the given world coordinate, clamped to the map
+        size_t to_tile_x(float x) const;
+        size_t to_tile_y(float y) const;
+
+        //Route for the cache, from the flow field of the destination once more than one route leads there
+        //Maps that are too large for flow fields use the route hierarchy instead
+        void calculate_route(size_t pos_x, size_t pos_y, size_t target_x, size_t target_y, vector<vec2>& route);
+
+        void draw_tiles(const TileBounds& area);
+
+        void build_flow_field(size_t target_x, size_t target_y, RouteSearch& search, FlowField& field) const;
+
+        //Flow fields take memory and a search over every tile per destination, larger maps use the route hierarchy
+        static constexpr size_t max_flow_field_tiles = 256 * 256;
+
+        size_t width = 0;
+        size_t height = 0;
 
         std::unique_ptr<Surface> grass_img;
         std::unique_ptr<Surface> forest_img;
@@ -61,6 +157,63 @@ namespace Tmpl8
         std::unique_ptr<Sprite> tile_mountains;
         std::unique_ptr<Sprite> tile_water;
 
-        std::array<std::array<TerrainTile, terrain_width>, terrain_height> tiles;
+        //Map as it looks on screen, composed once and only redrawn where tiles changed
+        std::unique_ptr<Surface> background;
+        vector<TileBounds> dirty_rects;
+
+        //Row major, y * width + x
+        vector<TerrainTile> tiles;
+
+        //Cost of stepping onto each tile, 0 for inaccessible tiles
+        vector<uint8_t> tile_costs;
+
+        //Flow fields by destination tile index
+        std::unordered_map<size_t, FlowField> flow_fields;
+        std::unordered_set<size_t> routed_destinations;
+
+        RouteHierarchy hierarchy;
+
+        //Cached routes as tile indices, one after the other
+        vector<uint32_t> route_tiles;
+
+        //First tile and length in route_tiles, by route id
+        vector<std::pair<uint32_t, uint32_t>> routes;
+
+        //(start tile << 32 | destination tile) -> route id
+        std::unordered_map<uint64_t, uint32_t> route_cache;
+        vector<vec2> route_scratch;
+
+        size_t route_cache_hits = 0;
+        size_t route_cache_misses = 0;
+
+        RouteSearch route_search;
+    };
+
+    //Read-only view of a route in the route cache of a Terrain, stays valid while the cache grows
+    class RouteView
+    {
+    public:
+        RouteView() = default;
+        RouteView(const vector<uint32_t>& tiles, uint32_t id, uint32_t begin, uint32_t length, size_t map_width) : tiles(&tiles), id(id), begin(begin), length(length), map_width(map_width) {}
+
+        //Id to get the route back from Terrain::get_cached_route
+        uint32_t get_id() const { return id; }
+
+        size_t size() const { return length; }
+        bool empty() const { return length == 0; }
+
+        //Top left corner of the i'th tile on the route
+        vec2 operator[](size_t i) const
+        {
+            const uint32_t tile = (*tiles)[begin + i];
+            return vec2((float)(tile % map_width) * Terrain::sprite_size, (float)(tile / map_width) * Terrain::sprite_size);
+        }
+
+    private:
+        const vector<uint32_t>* tiles = nullptr;
+        uint32_t id = Terrain::no_route;
+        uint32_t begin = 0;
+        uint32_t length = 0;
+        size_t map_width = 0;
     };
-}
\ No newline at end of file
+}
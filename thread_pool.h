@@ -10,90 +10,387 @@ class Worker;
 class Worker
 {
   public:
-    //Instantiate the worker class by passing and storing the threadpool as a reference
-    Worker(ThreadPool& s) : pool(s) {}
+    //Instantiate the worker class by passing and storing the threadpool as a reference, index is the deque this worker owns
+    Worker(ThreadPool& s, size_t index) : pool(s), index(index) {}
 
     inline void operator()();
 
   private:
     ThreadPool& pool;
+    size_t index;
 };
 
+//Work-stealing thread pool
+//Every worker owns a lock-free deque of tasks: it pushes and pops at the bottom while idle threads steal from the top
+//parallel_for keeps its tasks in these deques without allocating, enqueue() hands single tasks to the workers through a shared queue
 class ThreadPool
 {
   public:
-    ThreadPool(size_t numThreads) : stop(false)
+    ThreadPool(size_t numThreads) : num_threads(numThreads), deques(new TaskDeque[numThreads + 1])
     {
+        //The last deque belongs to the thread that calls parallel_for from outside the pool
+        workers.reserve(numThreads);
         for (size_t i = 0; i < numThreads; ++i)
-            workers.push_back(std::thread(Worker(*this)));
+            workers.push_back(std::thread(Worker(*this, i)));
     }
 
     ~ThreadPool()
     {
-        stop = true; // stop all threads
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            stop = true; // stop all threads
+        }
         condition.notify_all();
 
         for (auto& thread : workers)
             thread.join();
+
+        //Run tasks that were enqueued but never started, so nobody waits on their futures forever
+        for (Job* job : tasks)
+        {
+            job->run(*job, 0, 1);
+        }
     }
 
     template <class T>
     auto enqueue(T task) -> std::future<decltype(task())>
     {
+        using Result = decltype(task());
+
         //Wrap the function in a packaged_task so we can return a future object
-        auto wrapper = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+        FutureJob<Result>* job = new FutureJob<Result>(std::move(task));
+        std::future<Result> future = job->task.get_future();
+
+        pending_tasks.fetch_add(1);
 
         //Scope to restrict critical section
         {
             //lock our queue and add the given task to it
             std::unique_lock<std::mutex> lock(queue_mutex);
-
-            tasks.push_back([=] {
-                (*wrapper)();
-            });
+            tasks.push_back(job);
         }
 
         //Wake up a thread to start this task
-        condition.notify_one();
+        wake_workers();
+
+        return future;
+    }
+
+    size_t size() const { return num_threads; }
+
+    //Runs body(begin, end) over sub-ranges of [0, count) of at least min_chunk_size items and returns once all of them are done
+    //The range is split in halves on demand, so idle threads steal the largest pieces left and the calling thread helps until the end
+    //Can be called from one thread outside the pool at a time, or from inside a pool task
+    template <class T>
+    void parallel_for(size_t count, size_t min_chunk_size, const T& body)
+    {
+        if (count == 0) return;
 
-        return wrapper->get_future();
+        if (num_threads == 0 || count <= min_chunk_size)
+        {
+            body((size_t)0, count);
+            return;
+        }
+
+        //Begin and end are packed into 32 bits each in the deques
+        assert(count <= UINT32_MAX);
+
+        RangeJob<T> job(body);
+        job.grain = std::max(std::max(min_chunk_size, (size_t)1), count / ((num_threads + 1) * 8));
+        job.remaining.store(count, std::memory_order_relaxed);
+
+        const size_t index = calling_index();
+        run_task(Task{ &job, 0, count }, index);
+
+        //Help out until the chunks that were stolen are done as well, the job lives on this stack
+        while (job.remaining.load(std::memory_order_acquire) > 0)
+        {
+            Task task;
+            if (find_task(index, task))
+                run_task(task, index);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    //Frame-level barrier, returns once every enqueue'd task has finished (and helps running them meanwhile)
+    //Don't call this from an enqueue'd task, it would wait for itself
+    void barrier()
+    {
+        const size_t index = calling_index();
+        while (pending_tasks.load(std::memory_order_acquire) > 0)
+        {
+            if (!run_one(index)) std::this_thread::yield();
+        }
     }
 
   private:
     friend class Worker; //Gives access to the private variables of this class
 
+    //Idle rounds a worker spins before it goes to sleep, work usually arrives again within the same frame
+    static constexpr int spin_rounds = 256;
+
+    //Work that is split over tasks, run() is called for each sub-range
+    struct Job
+    {
+        void (*run)(Job& job, size_t begin, size_t end);
+        size_t grain = 1;
+        std::atomic<size_t> remaining{ 0 }; //Items that haven't been run yet
+    };
+
+    template <class T>
+    struct RangeJob : Job
+    {
+        RangeJob(const T& body) : body(body)
+        {
+            this->run = [](Job& job, size_t begin, size_t end) { static_cast<RangeJob&>(job).body(begin, end); };
+        }
+
+        const T& body;
+    };
+
+    //A task from enqueue(), deletes itself after running
+    template <class R>
+    struct FutureJob : Job
+    {
+        template <class F>
+        FutureJob(F&& function) : task(std::forward<F>(function))
+        {
+            this->run = [](Job& job, size_t, size_t) {
+                FutureJob* self = static_cast<FutureJob*>(&job);
+                self->task();
+                delete self;
+            };
+        }
+
+        std::packaged_task<R()> task;
+    };
+
+    struct Task
+    {
+        Job* job;
+        size_t begin;
+        size_t end;
+    };
+
+    //Chase-Lev deque with a fixed capacity (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models")
+    //Only the owner calls push and pop, any thread can steal
+    class alignas(64) TaskDeque
+    {
+      public:
+        bool push(const Task& task)
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed);
+            const int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= (int64_t)capacity) return false;
+
+            Slot& slot = slots[b & (capacity - 1)];
+            slot.job.store(task.job, std::memory_order_relaxed);
+            slot.range.store(((uint64_t)task.begin << 32) | (uint64_t)task.end, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        bool pop(Task& task)
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+
+            if (t > b)
+            {
+                //Empty
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            read(b, task);
+            if (t == b)
+            {
+                //Last task, a thief might be taking it at the same time
+                const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+
+            return true;
+        }
+
+        bool steal(Task& task)
+        {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) return false;
+
+            //The slot can be overwritten while we read it, but then top has moved on and the exchange fails
+            read(t, task);
+            return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+
+      private:
+        static constexpr size_t capacity = 256; //Power of two
+
+        struct Slot
+        {
+            std::atomic<Job*> job{ nullptr };
+            std::atomic<uint64_t> range{ 0 };
+        };
+
+        void read(int64_t i, Task& task) const
+        {
+            const Slot& slot = slots[i & (capacity - 1)];
+            const uint64_t range = slot.range.load(std::memory_order_relaxed);
+            task.job = slot.job.load(std::memory_order_relaxed);
+            task.begin = (size_t)(range >> 32);
+            task.end = (size_t)(range & 0xffffffff);
+        }
+
+        std::atomic<int64_t> top{ 0 };
+        alignas(64) std::atomic<int64_t> bottom{ 0 };
+        Slot slots[capacity];
+    };
+
+    //Deque of the calling thread: its own one for workers, the extra one for the thread outside the pool
+    size_t calling_index() const
+    {
+        return (current_pool == this) ? current_index : num_threads;
+    }
+
+    //Splits off upper halves for other threads while the range is larger than the grain, then runs what is left
+    void run_task(Task task, size_t index)
+    {
+        Job& job = *task.job;
+        while (task.end - task.begin > job.grain)
+        {
+            const size_t middle = task.begin + (task.end - task.begin) / 2;
+
+            //Deque full, run the rest here
+            if (!deques[index].push(Task{ &job, middle, task.end })) break;
+
+            wake_workers();
+            task.end = middle;
+        }
+
+        job.run(job, task.begin, task.end);
+
+        //The job can be gone after this, when the range was the last one
+        job.remaining.fetch_sub(task.end - task.begin, std::memory_order_acq_rel);
+    }
+
+    //Pops from our own deque, otherwise steals from the others
+    bool find_task(size_t index, Task& task)
+    {
+        if (deques[index].pop(task)) return true;
+
+        const size_t num_deques = num_threads + 1;
+        for (size_t i = 1; i < num_deques; i++)
+        {
+            if (deques[(index + i) % num_deques].steal(task)) return true;
+        }
+
+        return false;
+    }
+
+    //Runs a parallel_for task or an enqueue'd task, returns false when there was no work
+    bool run_one(size_t index)
+    {
+        Task task;
+        if (find_task(index, task))
+        {
+            run_task(task, index);
+            return true;
+        }
+
+        if (pending_tasks.load(std::memory_order_relaxed) == 0) return false;
+
+        Job* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (!tasks.empty())
+            {
+                job = tasks.front();
+                tasks.pop_front();
+            }
+        }
+
+        if (!job) return false;
+
+        job->run(*job, 0, 1);
+        pending_tasks.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void wake_workers()
+    {
+        work_epoch.fetch_add(1);
+        if (sleeping.load() > 0)
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            condition.notify_all();
+        }
+    }
+
+    //Workers only use num_threads, workers is still being filled when they start
+    const size_t num_threads;
     std::vector<std::thread> workers;
-    std::deque<std::function<void()>> tasks;
+    std::unique_ptr<TaskDeque[]> deques;
 
-    std::condition_variable condition; //Wakes up a thread when work is available
+    std::deque<Job*> tasks;           //Tasks from enqueue()
+    std::mutex queue_mutex;           //Lock for our queue
+    std::atomic<size_t> pending_tasks{ 0 }; //Enqueue'd tasks that haven't finished yet
 
-    std::mutex queue_mutex; //Lock for our queue
+    std::condition_variable condition; //Wakes up sleeping threads when work is available
+    std::mutex sleep_mutex;
+    std::atomic<uint64_t> work_epoch{ 0 }; //Changes whenever work is added
+    std::atomic<int> sleeping{ 0 };
     bool stop = false;
+
+    //Pool and deque index of the current thread, so nested parallel_for calls use the worker's own deque
+    static inline thread_local const ThreadPool* current_pool = nullptr;
+    static inline thread_local size_t current_index = 0;
 };
 
 inline void Worker::operator()()
 {
-    std::function<void()> task;
+    ThreadPool::current_pool = &pool;
+    ThreadPool::current_index = index;
+
+    int idle_rounds = 0;
     while (true)
     {
+        //Read before looking for work, so work added after the search below keeps us from sleeping
+        const uint64_t epoch = pool.work_epoch.load();
+
+        if (pool.run_one(index))
+        {
+            idle_rounds = 0;
+            continue;
+        }
+
+        if (++idle_rounds < ThreadPool::spin_rounds)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
         //Scope to restrict critical section
-        //This is important because we don't want to hold the lock while executing the task,
-        //because that would make it so only one task can be run simultaneously (aka sequantial)
         {
-            std::unique_lock<std::mutex> locker(pool.queue_mutex);
+            std::unique_lock<std::mutex> locker(pool.sleep_mutex);
 
-            //Wait until some work is ready or we are stopping the threadpool
-            //Because of spurious wakeups we need to check if there is actually a task available or we are stopping
-            pool.condition.wait(locker, [=] { return pool.stop || !pool.tasks.empty(); });
+            //Wait until some work is added or we are stopping the threadpool
+            //Because of spurious wakeups we need to check if there actually is new work or we are stopping
+            pool.sleeping++;
+            pool.condition.wait(locker, [&] { return pool.stop || pool.work_epoch.load() != epoch; });
+            pool.sleeping--;
 
             if (pool.stop) break;
-
-            task = pool.tasks.front();
-            pool.tasks.pop_front();
         }
 
-        task();
+        idle_rounds = 0;
     }
 }
 
-} // namespace Tmpl8
\ No newline at end of file
+} // namespace Tmpl8